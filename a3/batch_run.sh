@@ -1,7 +1,7 @@
 #!/bin/sh
 
 make
-for mode in OPT FIFO CLOCK LRU RANDOM
+for mode in OPT FIFO CLOCK LRU RANDOM ARC 2Q LIRS CLOCK-PRO
 do	mkdir -p out/$mode
 	for num_frames in 1 2 3 4 5 10 20 50 75 100 200 500 1000
 	do	echo $mode/$num_frames
@@ -0,0 +1,51 @@
+#!/bin/sh
+# Times every policy on synthetic traces from gen_trace.py and prints the
+# simulated memory accesses per second as CSV. Given the CSV of an earlier
+# run, also prints the change from it and fails if any policy got more than
+# 20% slower.
+#
+# Usage: ./bench.sh [<baseline csv>]
+
+baseline=$1
+frames=1000
+mkdir -p bench
+gcc frames.c -O2 -Wall -o bench/frames -lm || exit 1
+
+# Traces are generated once and reused, they only depend on the seed
+gen() {
+	[ -f bench/$1.in ] || python3 gen_trace.py -seed 1 $2 > bench/$1.in
+}
+gen zipf "zipf:2000000:pages=50000:alpha=0.9"
+gen loop "loop:2000000:pages=1100"
+gen phases "zipf:700000:pages=20000 loop:600000:pages=1200:offset=40000 \
+scan:100000:offset=60000 zipf:600000:pages=5000:offset=200000:writes=0.6"
+
+results=$(
+echo "trace,policy,accesses,seconds,accesses_per_second"
+for trace in zipf loop phases
+do	for policy in OPT FIFO CLOCK LRU RANDOM ARC 2Q LIRS CLOCK-PRO
+	do	start=$(date +%s.%N)
+		accesses=$(./bench/frames bench/$trace.in $frames $policy |
+			awk '/memory accesses/ {print $5}')
+		end=$(date +%s.%N)
+		echo "$trace,$policy,$accesses" | awk -F, -v t1=$start -v t2=$end \
+			'{printf "%s,%s,%s,%.3f,%.0f\n", $1, $2, $3, t2 - t1, $3 / (t2 - t1)}'
+	done
+done
+)
+
+if [ -z "$baseline" ]
+then	echo "$results"
+	exit 0
+fi
+echo "$results" | awk -F, -v OFS=, '
+	NR == FNR {base[$1 "," $2] = $5; next}
+	FNR == 1 {print $0, "change"; next}
+	{
+		change = base[$1 "," $2] ? $5 / base[$1 "," $2] - 1 : 0
+		if (change < -0.2) {
+			slower = 1
+		}
+		printf "%s,%+.1f%%\n", $0, change * 100
+	}
+	END {exit slower}' "$baseline" -
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Checks that resuming from a checkpoint gives the same results as a run
+# straight through, and that resuming with options the checkpoint wasn't made
+# with is refused.
+#
+# Usage: ./checkpoint_check.sh <tracefile> <checkpoint interval> <policy> <frames>
+
+trace=$1
+interval=$2
+policy=$3
+frames=$4
+ckpt=$(mktemp)
+trap 'rm -f $ckpt $ckpt.tmp' EXIT
+
+make > /dev/null
+status=0
+for options in "" "-tlb 16x4" "-tlb 16x4 -tlb 256x8:huge=8x4" "-prefetch markov" \
+	"-prefetch readahead -flusher 1000 16"
+do	full=$(./frames $trace $frames $policy $options)
+	./frames $trace $frames $policy $options -checkpoint $interval $ckpt > /dev/null
+	resumed=$(./frames $trace $frames $policy $options -resume $ckpt)
+	if [ "$full" = "$resumed" ]
+	then	echo "ok: resumed $options"
+	else	echo "FAIL: resumed $options differs from a full run"
+		status=1
+	fi
+done
+
+# A checkpoint made with a TLB and a prefetcher can't be resumed with others
+./frames $trace $frames $policy -tlb 16x4 -prefetch markov \
+	-checkpoint $interval $ckpt > /dev/null
+for options in "-tlb 64x8 -prefetch markov" "-tlb 16x4:random -prefetch markov" \
+	"-tlb 16x4 -tlb 64x8 -prefetch markov" "-tlb 16x4 -prefetch readahead" \
+	"-tlb 16x4" "-tlb 16x4 -prefetch markov -window 1000 /dev/null"
+do	if ./frames $trace $frames $policy $options -resume $ckpt 2>&1 |
+		grep -q "different options"
+	then	echo "ok: refused $options"
+	else	echo "FAIL: resumed with $options"
+		status=1
+	fi
+done
+exit $status
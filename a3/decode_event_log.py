@@ -0,0 +1,27 @@
+# Prints a binary event log written by `./frames ... -event-log <file>` in the
+# same format as the output of -verbose
+#
+# Usage: python3 decode_event_log.py <event log file>
+import struct
+import sys
+
+MAGIC = b"FRMEVT01"
+RECORD = struct.Struct("<II")
+
+with open(sys.argv[1], "rb") as f:
+    data = f.read()
+
+if data[: len(MAGIC)] != MAGIC:
+    sys.exit("Not a frames event log")
+
+out = []
+for read_page, written in RECORD.iter_unpack(data[len(MAGIC):]):
+    written_page = written >> 1
+    if written & 1:
+        out.append("Page 0x%05x was read from disk, page 0x%05x was written "
+                   "to the disk." % (read_page, written_page))
+    else:
+        out.append("Page 0x%05x was read from disk, page 0x%05x was dropped "
+                   "(it was not dirty)." % (read_page, written_page))
+if out:
+    print("\n".join(out))
@@ -1,49 +1,455 @@
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #define ADDR_BITS 32
-#define PAGE_SIZE_BITS 12
-const int VPN_BITS = ADDR_BITS - PAGE_SIZE_BITS;
+#define BASE_PAGE_SIZE_BITS 12
+// Page size is 4KB unless changed with -page-size
+int page_size_bits = BASE_PAGE_SIZE_BITS;
+int vpn_bits = ADDR_BITS - BASE_PAGE_SIZE_BITS;
+// Page numbers of all the processes, process i's page p being numbered
+// (i << vpn_bits) + p
+int num_pages;
+// Having more frames than there are virtual pages is pointless, so that's the
+// cap on the number of frames. With 4KB pages that is 2^20 (~10^6) frames.
+#define MAX_FRAMES (1 << (ADDR_BITS - BASE_PAGE_SIZE_BITS))
+
+int min(int a, int b) { return a <= b ? a : b; }
+int max(int a, int b) { return a >= b ? a : b; }
+long lmax(long a, long b) { return a >= b ? a : b; }
+
+struct policy;
+const struct policy *find_policy(const char *name);
+struct prefetcher;
+const struct prefetcher *find_prefetcher(const char *name);
+
+#define MAX_TAUS 16
+#define DEFAULT_LOOKAHEAD (1 << 20)
+
+// Huge pages in the mixed mode are 2MB, so they cover 2^9 base pages
+#define HUGE_PAGE_BITS 9
+#define DEFAULT_PROMOTE_THRESHOLD 64
+
+#define MAX_TLB_LEVELS 4
+
+#define MAX_PROCS 16
+
+// How frames are shared between processes
+enum partition { GLOBAL, FIXED, WORKING_SET };
+#define DEFAULT_REBALANCE_INTERVAL 100000
+
+// Latencies of the disk in microseconds unless changed with -latency
+#define DEFAULT_READ_LATENCY 100.0
+#define DEFAULT_WRITE_LATENCY 200.0
 
-enum strategy_t { OPT, FIFO, CLOCK, LRU, RANDOM };
+// One level of the TLB. Each of its arrays is set associative.
+struct tlb_config {
+  int sets, ways;
+  bool random;              // Replacement within a set is random instead of LRU
+  int huge_sets, huge_ways; // Separate entries for huge pages, 0 if none
+};
 
 struct cmdline_args_t {
-  FILE *input_file;
+  FILE *input_file; // NULL if there are several processes
   int num_frames;
-  enum strategy_t strategy;
+  const struct policy *policy;
   bool verbose;
+  FILE *event_log_file; // For the binary event log, NULL if not asked for
+  int window_size;      // Accesses per window of statistics, 0 if not asked for
+  const char *window_filename;
+  FILE *window_file;
+  bool window_json; // Whether window statistics are JSON instead of CSV
+
+  // For analysing the trace instead of simulating it
+  bool analyze;
+  long sample_interval; // Accesses between samples of working set sizes
+  int num_taus;
+  long taus[MAX_TAUS]; // Window lengths for the working set sizes
+
+  double sample_rate; // Fraction of pages kept when sampling, 1 if not sampling
+
+  // Whether to simulate accesses as they're read instead of reading the whole
+  // trace first. OPT then only looks lookahead accesses into the future.
+  bool streaming;
+  long lookahead;
+
+  int num_tlb_levels; // 0 if TLBs aren't simulated
+  struct tlb_config tlb_levels[MAX_TLB_LEVELS];
+
+  bool page_size_given; // Whether to report the effects of the page size
+  // Whether 2MB regions are promoted to huge pages once promote_threshold of
+  // their base pages have been faulted in
+  bool mixed_pages;
+  int promote_threshold;
+
+  const struct prefetcher *prefetcher; // NULL if not prefetching
+
+  bool latency_given; // Whether to report the estimated stall time
+  double read_latency, write_latency;
+  // A background flusher writes back up to flush_pages of the pages dirty
+  // the longest every flush_interval memory accesses, if flush_interval isn't 0
+  int flush_interval;
+  int flush_pages;
+
+  // Processes whose traces are replayed together, each in its own address
+  // space. Their accesses are interleaved round robin, quantum at a time, or
+  // by the timestamps at the end of their lines.
+  int num_procs;
+  const char *trace_names[MAX_PROCS];
+  FILE *trace_files[MAX_PROCS];
+  bool interleave_by_time;
+  int quantum;
+  enum partition partition;
+  long rebalance_interval; // Accesses between repartitioning by working sets
+
+  // Checkpoints are written to checkpoint_file every checkpoint_interval memory
+  // accesses, if it isn't 0. When sampling, only accesses to sampled pages
+  // count towards it.
+  long checkpoint_interval;
+  const char *checkpoint_file;
+  const char *resume_file; // Checkpoint to continue from, NULL if none
 } cmdline_args;
 
+void print_usage() {
+  fprintf(stderr, "Usage: ./frames <tracefile>[,<tracefile>...] <number of "
+                  "frames> <replacement policy> [options]\n"
+                  "       ./frames <tracefile> -analyze <sample interval> "
+                  "[<tau>...] [-sample <rate>]\n"
+                  "Options:\n"
+                  "  -verbose            Print each eviction\n"
+                  "  -event-log <file>   Write each eviction to file in the "
+                  "binary format read\n"
+                  "                      by decode_event_log.py\n"
+                  "  -window <N> <file>  Write statistics for every N memory "
+                  "accesses to file,\n"
+                  "                      as JSON if its name ends with .json "
+                  "and CSV otherwise\n"
+                  "  -sample <rate>      Only simulate the given fraction of "
+                  "pages, with as many\n"
+                  "                      fewer frames, and estimate the miss "
+                  "ratio from them\n"
+                  "  -stream             Simulate accesses as they are read, "
+                  "the default when\n"
+                  "                      the tracefile is - (stdin)\n"
+                  "  -lookahead <N>      Accesses OPT looks ahead when "
+                  "streaming (default %d)\n"
+                  "  -tlb <spec>         Add a TLB level in front of the page "
+                  "table, the first one\n"
+                  "                      given is L1. spec is "
+                  "<sets>x<ways>[:lru|:random][:huge=<sets>x<ways>]\n"
+                  "  -page-size <size>   4K (default), 2M or 1G pages, or "
+                  "mixed for 4K pages\n"
+                  "                      with hot 2MB regions promoted to "
+                  "huge pages\n"
+                  "  -promote <N>        Base pages of a region faulted in "
+                  "before it's promoted\n"
+                  "                      in the mixed mode (default %d)\n"
+                  "  -prefetch <name>    Bring in more pages on a fault, "
+                  "with readahead, stride\n"
+                  "                      or markov\n"
+                  "  -latency <r>:<w>    Disk read and write latencies in "
+                  "microseconds for the\n"
+                  "                      estimated stall time (default "
+                  "%.0f:%.0f)\n"
+                  "  -flusher <N> <P>    Write back up to P dirty pages in "
+                  "the background every\n"
+                  "                      N memory accesses\n"
+                  "  -interleave <how>   With several tracefiles, one process "
+                  "each, interleave\n"
+                  "                      them rr[:<quantum>] (default rr:1) "
+                  "or by time, the\n"
+                  "                      timestamp ending each line, or its "
+                  "line number if none\n"
+                  "  -partition <how>    Share frames between processes "
+                  "global (default),\n"
+                  "                      fixed equally, or ws[:<N>] by "
+                  "working set sizes over\n"
+                  "                      every N memory accesses (default "
+                  "%d)\n"
+                  "  -checkpoint <N> <file>\n"
+                  "                      Save the state of the simulation to "
+                  "file every N memory\n"
+                  "                      accesses, counting only those to "
+                  "sampled pages with\n"
+                  "                      -sample\n"
+                  "  -resume <file>      Continue from a checkpoint, with the "
+                  "same tracefile and\n"
+                  "                      options. With another policy, it "
+                  "starts with the pages\n"
+                  "                      in memory at the checkpoint. The "
+                  "-window file carries on\n"
+                  "                      from the checkpoint too\n"
+                  "Memory used when streaming is bounded by the lookahead, "
+                  "for OPT, and\nconstant for others.\n",
+          DEFAULT_LOOKAHEAD, DEFAULT_PROMOTE_THRESHOLD, DEFAULT_READ_LATENCY,
+          DEFAULT_WRITE_LATENCY, DEFAULT_REBALANCE_INTERVAL);
+}
+
+long parse_positive(const char *str, long max_value, const char *what) {
+  char *end;
+  errno = 0;
+  long res = strtol(str, &end, 10);
+  if (errno || res <= 0 || res > max_value || end[0] != '\0' ||
+      str[0] == '\0') {
+    fprintf(stderr, "Invalid %s %s, it should be in range [1, %ld]\n", what,
+            str, max_value);
+    exit(1);
+  }
+  return res;
+}
+
+double parse_sample_rate(const char *str) {
+  char *end;
+  double rate = strtod(str, &end);
+  if (!(rate > 0 && rate <= 1) || end[0] != '\0' || str[0] == '\0') {
+    fprintf(stderr, "Invalid sampling rate %s, it should be in (0, 1]\n", str);
+    exit(1);
+  }
+  return rate;
+}
+
+// Parses "<sets>x<ways>" at str, returning where it ended
+const char *parse_tlb_geometry(const char *str, int *sets, int *ways) {
+  char *end;
+  long num_sets = strtol(str, &end, 10);
+  if (end == str || *end != 'x') {
+    return NULL;
+  }
+  const char *ways_str = end + 1;
+  long num_ways = strtol(ways_str, &end, 10);
+  if (end == ways_str || num_sets <= 0 || num_ways <= 0 ||
+      num_sets > MAX_FRAMES || num_ways > MAX_FRAMES) {
+    return NULL;
+  }
+  *sets = num_sets;
+  *ways = num_ways;
+  return end;
+}
+
+struct tlb_config parse_tlb_config(const char *spec) {
+  struct tlb_config config = {.random = false, .huge_sets = 0};
+  const char *rest = parse_tlb_geometry(spec, &config.sets, &config.ways);
+  while (rest && *rest == ':') {
+    rest++;
+    if (strncmp(rest, "lru", 3) == 0) {
+      config.random = false;
+      rest += 3;
+    } else if (strncmp(rest, "random", 6) == 0) {
+      config.random = true;
+      rest += 6;
+    } else if (strncmp(rest, "huge=", 5) == 0) {
+      rest = parse_tlb_geometry(rest + 5, &config.huge_sets,
+                                &config.huge_ways);
+    } else {
+      rest = NULL;
+    }
+  }
+  if (!rest || *rest != '\0') {
+    fprintf(stderr, "Invalid TLB %s\n", spec);
+    print_usage();
+    exit(1);
+  }
+  return config;
+}
+
+FILE *open_trace_file(const char *filename) {
+  if (strcmp(filename, "-") == 0) {
+    return stdin;
+  }
+  FILE *file = fopen(filename, "r");
+  if (!file) {
+    perror("Opening trace file");
+    exit(1);
+  }
+  return file;
+}
+
 struct cmdline_args_t extract_cmdline_args(int argc, char *argv[]) {
-  struct cmdline_args_t args;
-  if (argc == 5) {
-    assert(strcmp(argv[argc - 1], "-verbose") == 0 &&
-           "-verbose should be the last argument passed, if it is present");
-    args.verbose = true;
-  } else {
-    args.verbose = false;
+  struct cmdline_args_t args = {.verbose = false,
+                                .event_log_file = NULL,
+                                .window_size = 0,
+                                .sample_rate = 1,
+                                .lookahead = DEFAULT_LOOKAHEAD,
+                                .promote_threshold =
+                                    DEFAULT_PROMOTE_THRESHOLD,
+                                .read_latency = DEFAULT_READ_LATENCY,
+                                .write_latency = DEFAULT_WRITE_LATENCY,
+                                .quantum = 1,
+                                .partition = GLOBAL};
+
+  if (argc >= 4 && strcmp(argv[2], "-analyze") == 0) {
+    args.analyze = true;
+    args.input_file = open_trace_file(argv[1]);
+    args.trace_files[0] = args.input_file;
+    args.num_procs = 1;
+    num_pages = 1 << vpn_bits;
+    args.sample_interval = parse_positive(argv[3], LONG_MAX, "sample interval");
+    for (int i = 4; i < argc; i++) {
+      if (strcmp(argv[i], "-sample") == 0 && i + 1 < argc) {
+        args.sample_rate = parse_sample_rate(argv[++i]);
+        continue;
+      }
+      if (args.num_taus == MAX_TAUS) {
+        fprintf(stderr, "At most %d values of tau can be given\n", MAX_TAUS);
+        exit(1);
+      }
+      args.taus[args.num_taus++] = parse_positive(argv[i], LONG_MAX, "tau");
+    }
+    if (args.num_taus == 0) {
+      long default_taus[] = {1000, 10000, 100000, 1000000};
+      args.num_taus = 4;
+      memcpy(args.taus, default_taus, sizeof(default_taus));
+    }
+    return args;
   }
 
-  if (argc != 4 && argc != 5) {
-    fprintf(stderr, "Usage: ./frames <tracefile> <number of frames> "
-                    "<replacement policy> [-verbose]\n");
+  if (argc < 4) {
+    print_usage();
     exit(1);
   }
 
+  for (int i = 4; i < argc; i++) {
+    if (strcmp(argv[i], "-verbose") == 0) {
+      args.verbose = true;
+    } else if (strcmp(argv[i], "-event-log") == 0 && i + 1 < argc) {
+      args.event_log_file = fopen(argv[++i], "wb");
+      if (!args.event_log_file) {
+        perror("Opening event log file");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-window") == 0 && i + 2 < argc) {
+      args.window_size = parse_positive(argv[++i], INT_MAX, "window size");
+      args.window_filename = argv[++i];
+      size_t len = strlen(args.window_filename);
+      args.window_json =
+          len >= 5 && strcmp(args.window_filename + len - 5, ".json") == 0;
+    } else if (strcmp(argv[i], "-sample") == 0 && i + 1 < argc) {
+      args.sample_rate = parse_sample_rate(argv[++i]);
+    } else if (strcmp(argv[i], "-stream") == 0) {
+      args.streaming = true;
+    } else if (strcmp(argv[i], "-lookahead") == 0 && i + 1 < argc) {
+      // Bounded so that the window of accesses fits in memory
+      args.lookahead = parse_positive(argv[++i], INT_MAX, "lookahead");
+    } else if (strcmp(argv[i], "-tlb") == 0 && i + 1 < argc) {
+      if (args.num_tlb_levels == MAX_TLB_LEVELS) {
+        fprintf(stderr, "At most %d TLB levels are supported\n",
+                MAX_TLB_LEVELS);
+        exit(1);
+      }
+      args.tlb_levels[args.num_tlb_levels++] = parse_tlb_config(argv[++i]);
+    } else if (strcmp(argv[i], "-page-size") == 0 && i + 1 < argc) {
+      args.page_size_given = true;
+      char *size = argv[++i];
+      if (strcmp(size, "4K") == 0) {
+        page_size_bits = 12;
+      } else if (strcmp(size, "2M") == 0) {
+        page_size_bits = 21;
+      } else if (strcmp(size, "1G") == 0) {
+        page_size_bits = 30;
+      } else if (strcmp(size, "mixed") == 0) {
+        page_size_bits = 12;
+        args.mixed_pages = true;
+      } else {
+        fprintf(stderr, "Page size should be one of 4K, 2M, 1G or mixed\n");
+        exit(1);
+      }
+      vpn_bits = ADDR_BITS - page_size_bits;
+    } else if (strcmp(argv[i], "-promote") == 0 && i + 1 < argc) {
+      args.promote_threshold =
+          parse_positive(argv[++i], 1 << HUGE_PAGE_BITS, "promote threshold");
+    } else if (strcmp(argv[i], "-prefetch") == 0 && i + 1 < argc) {
+      args.prefetcher = find_prefetcher(argv[++i]);
+      if (!args.prefetcher) {
+        fprintf(stderr, "Unrecognized prefetcher. Available ones are "
+                        "readahead, stride and markov\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-latency") == 0 && i + 1 < argc) {
+      args.latency_given = true;
+      char *end;
+      args.read_latency = strtod(argv[++i], &end);
+      if (*end == ':') {
+        args.write_latency = strtod(end + 1, &end);
+      }
+      if (*end != '\0' || !(args.read_latency >= 0) ||
+          !(args.write_latency >= 0)) {
+        fprintf(stderr, "Invalid latencies %s\n", argv[i]);
+        print_usage();
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-flusher") == 0 && i + 2 < argc) {
+      args.latency_given = true;
+      args.flush_interval =
+          parse_positive(argv[++i], INT_MAX, "flusher interval");
+      args.flush_pages = parse_positive(argv[++i], MAX_FRAMES, "flush pages");
+    } else if (strcmp(argv[i], "-interleave") == 0 && i + 1 < argc) {
+      char *how = argv[++i];
+      if (strcmp(how, "time") == 0) {
+        args.interleave_by_time = true;
+      } else if (strncmp(how, "rr:", 3) == 0) {
+        args.quantum = parse_positive(how + 3, INT_MAX, "quantum");
+      } else if (strcmp(how, "rr") != 0) {
+        fprintf(stderr, "Interleaving should be rr[:<quantum>] or time\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-partition") == 0 && i + 1 < argc) {
+      char *how = argv[++i];
+      if (strcmp(how, "global") == 0) {
+        args.partition = GLOBAL;
+      } else if (strcmp(how, "fixed") == 0) {
+        args.partition = FIXED;
+      } else if (strncmp(how, "ws", 2) == 0 &&
+                 (how[2] == '\0' || how[2] == ':')) {
+        args.partition = WORKING_SET;
+        args.rebalance_interval = DEFAULT_REBALANCE_INTERVAL;
+        if (how[2] == ':') {
+          args.rebalance_interval =
+              parse_positive(how + 3, LONG_MAX, "rebalance interval");
+        }
+      } else {
+        fprintf(stderr, "Partitioning should be global, fixed or ws[:<N>]\n");
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-checkpoint") == 0 && i + 2 < argc) {
+      args.checkpoint_interval =
+          parse_positive(argv[++i], LONG_MAX, "checkpoint interval");
+      args.checkpoint_file = argv[++i];
+    } else if (strcmp(argv[i], "-resume") == 0 && i + 1 < argc) {
+      args.resume_file = argv[++i];
+    } else {
+      print_usage();
+      exit(1);
+    }
+  }
+
   char *filename = argv[1];
   char *num_frames_str = argv[2];
   char *strat_str = argv[3];
 
-  args.input_file = fopen(filename, "r");
-  if (!args.input_file) {
-    perror("Opening trace file");
+  for (char *name = strtok(filename, ","); name; name = strtok(NULL, ",")) {
+    if (args.num_procs == MAX_PROCS) {
+      fprintf(stderr, "At most %d tracefiles can be given\n", MAX_PROCS);
+      exit(1);
+    }
+    args.trace_names[args.num_procs] = name;
+    args.trace_files[args.num_procs++] = open_trace_file(name);
+  }
+  if (args.num_procs == 0) {
+    print_usage();
     exit(1);
   }
+  args.input_file = args.num_procs == 1 ? args.trace_files[0] : NULL;
+  for (int i = 0; i < args.num_procs; i++) {
+    args.streaming = args.streaming || args.trace_files[i] == stdin;
+  }
+  num_pages = args.num_procs << vpn_bits;
 
   char *end;
   long res = strtol(num_frames_str, &end, 10);
@@ -51,8 +457,9 @@ struct cmdline_args_t extract_cmdline_args(int argc, char *argv[]) {
     perror("Number of frames");
     exit(1);
   }
-  if (res <= 0 || res > 1000) {
-    fprintf(stderr, "The number of pages should be in range [1, 1000]\n");
+  if (res <= 0 || res > num_pages) {
+    fprintf(stderr, "The number of pages should be in range [1, %d]\n",
+            num_pages);
     exit(1);
   }
   if (end[0] != '\0' || num_frames_str[0] == '\0') {
@@ -60,19 +467,44 @@ struct cmdline_args_t extract_cmdline_args(int argc, char *argv[]) {
     exit(1);
   }
   args.num_frames = res;
+  if (args.sample_rate < 1) {
+    // Sampled pages compete for proportionally fewer frames
+    args.num_frames = max(1, (int)(res * args.sample_rate + 0.5));
+  }
+  if (args.partition != GLOBAL && args.num_frames < args.num_procs) {
+    fprintf(stderr, "Each process needs at least one frame\n");
+    exit(1);
+  }
 
-  if (strcmp(strat_str, "OPT") == 0) {
-    args.strategy = OPT;
-  } else if (strcmp(strat_str, "FIFO") == 0) {
-    args.strategy = FIFO;
-  } else if (strcmp(strat_str, "CLOCK") == 0) {
-    args.strategy = CLOCK;
-  } else if (strcmp(strat_str, "LRU") == 0) {
-    args.strategy = LRU;
-  } else if (strcmp(strat_str, "RANDOM") == 0) {
-    args.strategy = RANDOM;
-  } else {
-    fprintf(stderr, "Unrecognized page replacement strategy\n");
+  args.policy = find_policy(strat_str);
+  if (!args.policy) {
+    fprintf(stderr, "Unrecognized page replacement strategy. Available ones "
+                    "are OPT, FIFO, CLOCK, LRU, RANDOM, ARC, 2Q, LIRS and "
+                    "CLOCK-PRO\n");
+    exit(1);
+  }
+  // Repartitioning rebuilds the policy state from the resident pages, which
+  // OPT can't do without going through the trace again
+  if (args.partition == WORKING_SET && args.policy == find_policy("OPT")) {
+    fprintf(stderr, "OPT can't be used with working set partitioning\n");
+    exit(1);
+  }
+  if (args.window_size) {
+    // When resuming, the windows before the checkpoint are kept
+    args.window_file =
+        args.resume_file ? fopen(args.window_filename, "r+") : NULL;
+    if (!args.window_file) {
+      args.window_file = fopen(args.window_filename, "w");
+    }
+    if (!args.window_file) {
+      perror("Opening window statistics file");
+      exit(1);
+    }
+  }
+  // Accesses OPT has looked ahead at when streaming aren't saved
+  if (args.streaming && args.policy == find_policy("OPT") &&
+      (args.checkpoint_interval || args.resume_file)) {
+    fprintf(stderr, "OPT can't be checkpointed when streaming\n");
     exit(1);
   }
 
@@ -88,6 +520,28 @@ struct condensed_memory_op {
   int page_num;
   bool read;
   bool write;
+  long num_accesses; // Number of consecutive accesses condensed into this one
+};
+
+// A condensed access as it's kept for the whole trace, in 4 bytes. The page
+// numbers of all the processes fit in PACKED_PAGE_BITS, and runs too long for
+// num_accesses are kept in long_runs instead.
+#define PACKED_PAGE_BITS 24
+#define RUN_BITS (32 - PACKED_PAGE_BITS - 2)
+#define LONG_RUN ((1 << RUN_BITS) - 1)
+struct packed_memory_op {
+  unsigned page_num : PACKED_PAGE_BITS;
+  unsigned read : 1;
+  unsigned write : 1;
+  unsigned num_accesses : RUN_BITS; // LONG_RUN if it's in long_runs
+};
+_Static_assert(MAX_PROCS << (ADDR_BITS - BASE_PAGE_SIZE_BITS) <=
+                   1 << PACKED_PAGE_BITS,
+               "Page numbers don't fit in a packed_memory_op");
+
+struct long_run {
+  long index; // Of the condensed access in condensed_mem_accesses
+  long num_accesses;
 };
 
 struct memory_op get_next_access(FILE *file) {
@@ -103,7 +557,7 @@ struct memory_op get_next_access(FILE *file) {
     return op;
   }
 
-  op.page_num = virtual_addr >> PAGE_SIZE_BITS;
+  op.page_num = virtual_addr >> page_size_bits;
   switch (access_type) {
   case 'R':
     op.type = READ;
@@ -118,65 +572,129 @@ struct memory_op get_next_access(FILE *file) {
   return op;
 }
 
-const int INIT_SIZE = 20;
-struct memory_op *get_all_accesses(FILE *file, int *size) {
-  int capacity = INIT_SIZE;
-  struct memory_op *mem_accesses = malloc(capacity * sizeof(struct memory_op));
-  *size = 0;
-
-  while (true) {
-    struct memory_op op = get_next_access(file);
-    if (op.page_num == -1) { // File finished
-      break;
+// Reads what's left of the line after an access, returning the timestamp in it
+// or default_time if there's none
+long read_timestamp(FILE *file, long default_time) {
+  long time = default_time;
+  int c = getc(file);
+  while (c == ' ' || c == '\t') {
+    c = getc(file);
+  }
+  if (c >= '0' && c <= '9') {
+    time = 0;
+    for (; c >= '0' && c <= '9'; c = getc(file)) {
+      time = time * 10 + c - '0';
     }
+  }
+  while (c != '\n' && c != EOF) {
+    c = getc(file);
+  }
+  return time;
+}
+
+// With several processes, their traces are merged into one as they're read
+struct {
+  struct memory_op next[MAX_PROCS]; // Next access of each, -1 if it's done
+  long next_time[MAX_PROCS];
+  long num_read[MAX_PROCS];
+  int curr;  // Process the current quantum is of, for round robin
+  int taken; // Accesses taken from it in this quantum
+} merge;
+
+void read_process_access(int proc) {
+  FILE *file = cmdline_args.trace_files[proc];
+  merge.next[proc] = get_next_access(file);
+  if (merge.next[proc].page_num == -1) {
+    return;
+  }
+  merge.next[proc].page_num += proc << vpn_bits;
+  if (cmdline_args.interleave_by_time) {
+    merge.next_time[proc] = read_timestamp(file, merge.num_read[proc]);
+  }
+  merge.num_read[proc]++;
+}
 
-    if (*size == capacity) {
-      capacity *= 2;
-      mem_accesses = realloc(mem_accesses, capacity * sizeof(*mem_accesses));
-      if (!mem_accesses) {
-        perror("Inputting trace file");
+void open_merged_traces() {
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    read_process_access(i);
+  }
+}
+
+// Process to take the next access from, -1 once they're all done
+int next_process() {
+  int n = cmdline_args.num_procs;
+  if (cmdline_args.interleave_by_time) {
+    int earliest = -1;
+    for (int i = 0; i < n; i++) {
+      if (merge.next[i].page_num != -1 &&
+          (earliest == -1 || merge.next_time[i] < merge.next_time[earliest])) {
+        earliest = i;
       }
     }
+    return earliest;
+  }
 
-    mem_accesses[*size] = op;
-    *size += 1;
+  if (merge.taken < cmdline_args.quantum &&
+      merge.next[merge.curr].page_num != -1) {
+    merge.taken++;
+    return merge.curr;
   }
+  for (int i = 1; i <= n; i++) {
+    int proc = (merge.curr + i) % n;
+    if (merge.next[proc].page_num != -1) {
+      merge.curr = proc;
+      merge.taken = 1;
+      return proc;
+    }
+  }
+  return -1;
+}
 
-  return mem_accesses;
+struct memory_op next_merged_access() {
+  int proc = next_process();
+  if (proc == -1) {
+    return (struct memory_op){.page_num = -1};
+  }
+  struct memory_op op = merge.next[proc];
+  read_process_access(proc);
+  return op;
 }
 
-struct condensed_memory_op *condense_accesses(struct memory_op *mem_accesses,
-                                              int num_accesses,
-                                              int *num_condensed_accesses) {
-  struct condensed_memory_op *ops =
-      malloc(num_accesses * sizeof(struct condensed_memory_op));
+// Next access of the trace in file, or of the merged traces if it's NULL
+struct memory_op next_access(FILE *file) {
+  return file ? get_next_access(file) : next_merged_access();
+}
 
-  int idx = 0;
+// Reads the trace one condensed access at a time, for streaming
+struct access_stream {
+  FILE *file;
+  struct memory_op next; // First access of the next condensed access
+};
 
-  int page_num = mem_accesses[0].page_num;
-  bool read = mem_accesses[0].type == READ;
-  bool write = mem_accesses[0].type == WRITE;
-  for (int i = 1; i < num_accesses + 1; i++) {
-    if (i == num_accesses || mem_accesses[i].page_num != page_num) {
-      ops[idx++] = (struct condensed_memory_op){
-          .page_num = page_num, .read = read, .write = write};
+void open_access_stream(struct access_stream *stream, FILE *file) {
+  stream->file = file;
+  stream->next = next_access(file);
+}
 
-      if (i == num_accesses) {
-        break;
-      }
+bool next_condensed_access(struct access_stream *stream,
+                           struct condensed_memory_op *op) {
+  if (stream->next.page_num == -1) { // File finished
+    return false;
+  }
 
-      page_num = mem_accesses[i].page_num;
-      read = mem_accesses[i].type == READ;
-      write = mem_accesses[i].type == WRITE;
-    } else {
-      read = read || mem_accesses[i].type == READ;
-      write = write || mem_accesses[i].type == WRITE;
+  *op = (struct condensed_memory_op){.page_num = stream->next.page_num,
+                                     .read = stream->next.type == READ,
+                                     .write = stream->next.type == WRITE,
+                                     .num_accesses = 1};
+  while (true) {
+    stream->next = next_access(stream->file);
+    if (stream->next.page_num != op->page_num) {
+      return true;
     }
+    op->read = op->read || stream->next.type == READ;
+    op->write = op->write || stream->next.type == WRITE;
+    op->num_accesses++;
   }
-
-  *num_condensed_accesses = idx;
-  return realloc(ops,
-                 *num_condensed_accesses * sizeof(struct condensed_memory_op));
 }
 
 struct page_table_entry {
@@ -184,276 +702,2968 @@ struct page_table_entry {
   int frame_num;
   bool valid;
   bool dirty;
-  bool use;    // For CLOCK
-  int used_at; // FOR LRU
+  bool accessed;   // Accessed since it was brought in, for the mixed mode
+  bool prefetched; // Brought in by the prefetcher and not accessed since
+  long last_access; // Number of memory accesses done when it was last accessed
 };
 
 struct page_table_entry *page_table;
 int next_free_frame = 0;
+// Frames the running process can use, all of them unless they're partitioned
+int num_frames;
 
 struct {
-  int mem_accesses; // Memory accesses
-  int num_misses;   // Number of Page Faults
-  int num_writes;   // Number of writes to the disk
-  int num_drops;    // Number of drops
+  long mem_accesses; // Memory accesses
+  long num_misses; // Number of Page Faults
+  long num_writes; // Number of writes to the disk
+  long num_drops;  // Number of drops
+  int num_dirty;    // Number of dirty pages in memory right now
+  int num_prefetches;       // Pages brought in by the prefetcher
+  int num_useful_prefetches; // Of them, accessed before being evicted
+  int num_wasted_prefetches; // Of them, evicted without being accessed
+  int num_flushes;           // Writes to the disk by the flusher
+  double stall_time;         // Microseconds spent waiting for the disk
+  double write_stall_time;   // Of them, waiting for dirty pages to be written
 } stats;
 
+// When sampling, accesses and misses of each sampled page for the confidence
+// interval of the estimated miss ratio
+long *page_accesses, *page_misses;
+long sampled_accesses; // Number of memory accesses to sampled pages
+
+// When sampling, the accesses are those of the whole trace, but the misses,
+// writes and drops only those of the sampled pages
 void print_stats() {
-  printf("Number of memory accesses: %d\n", stats.mem_accesses);
-  printf("Number of misses: %d\n", stats.num_misses);
-  printf("Number of writes: %d\n", stats.num_writes);
-  printf("Number of drops: %d\n", stats.num_drops);
+  const char *sampled = cmdline_args.sample_rate < 1 ? "sampled " : "";
+  printf("Number of memory accesses: %ld\n", stats.mem_accesses);
+  printf("Number of %smisses: %ld\n", sampled, stats.num_misses);
+  printf("Number of %swrites: %ld\n", sampled, stats.num_writes);
+  printf("Number of %sdrops: %ld\n", sampled, stats.num_drops);
 }
 
-// Trying to store results of future uses in the page table itself. This will
-// help keep track of till which index in the mem_accesses list have we looked.
-int counted_till = -1;
+// For -window. Statistics for a window are the difference between stats at
+// its end and at its start, so nothing extra is done per access except
+// checking whether the window has ended.
+struct {
+  int num_windows;
+  long start;     // Number of accesses done at the start of this window
+  long next_end;   // Number of accesses done when this window ends
+  long num_misses; // Values of stats at the start of this window
+  long num_writes;
+  long num_drops;
+  long file_offset; // Length of the window file at the last checkpoint
+} window;
+
+void write_window_header() {
+  if (cmdline_args.window_json) {
+    fprintf(cmdline_args.window_file, "[");
+  } else {
+    fprintf(cmdline_args.window_file, "start,end,accesses,misses,fault_rate,"
+                                      "writes,drops,dirty_pages\n");
+  }
+}
 
-// Assuming this doesn't overflow. This is realistic since >1e9 memory accesses
-// would take a long time to simulate
-int access_num = 0;
-void count_access(struct page_table_entry *pte, int access_idx) {
-  pte->use = 1;
-  pte->used_at = access_num++;
+// When resuming, the header was written before the checkpoint
+void start_windows() {
+  window.next_end = cmdline_args.window_size;
+  if (!cmdline_args.resume_file) {
+    write_window_header();
+  }
 }
 
-struct condensed_memory_op *condensed_mem_accesses;
-int num_condensed_accesses;
-int curr_access;
+// Drops whatever was written to the window file after the checkpoint, so that
+// the windows go on from there. If the file doesn't have all the windows up to
+// the checkpoint anymore, it is started over with just the windows after it.
+void resume_windows() {
+  FILE *file = cmdline_args.window_file;
+  fseek(file, 0, SEEK_END);
+  bool complete = ftell(file) >= window.file_offset;
+  if (!complete) {
+    fprintf(stderr, "%s doesn't have the windows before the checkpoint, so "
+                    "it will only have those after it\n",
+            cmdline_args.window_filename);
+    window.file_offset = 0;
+    window.num_windows = 0;
+  }
+  if (ftruncate(fileno(file), window.file_offset)) {
+    perror("Truncating window statistics file");
+    exit(1);
+  }
+  fseek(file, 0, SEEK_END);
+  if (!complete) {
+    write_window_header();
+  }
+}
 
-struct page_table_entry **frame_list;
-int fifo_pos = 0;
+// A window can only end between condensed accesses, so it may be a little
+// longer than the window size.
+void end_window(long accesses_done) {
+  long accesses = accesses_done - window.start;
+  long misses = stats.num_misses - window.num_misses;
+  long writes = stats.num_writes - window.num_writes;
+  long drops = stats.num_drops - window.num_drops;
+  double fault_rate = accesses ? (double)misses / accesses : 0;
+
+  if (cmdline_args.window_json) {
+    fprintf(cmdline_args.window_file,
+            "%s\n  {\"start\": %ld, \"end\": %ld, \"accesses\": %ld, "
+            "\"misses\": %ld, \"fault_rate\": %.6f, \"writes\": %ld, "
+            "\"drops\": %ld, \"dirty_pages\": %d}",
+            window.num_windows ? "," : "", window.start, accesses_done,
+            accesses, misses, fault_rate, writes, drops, stats.num_dirty);
+  } else {
+    fprintf(cmdline_args.window_file, "%ld,%ld,%ld,%ld,%.6f,%ld,%ld,%d\n",
+            window.start, accesses_done, accesses, misses, fault_rate, writes,
+            drops, stats.num_dirty);
+  }
 
-struct page_table_entry *evict_page_fifo(struct page_table_entry *new_page) {
-  struct page_table_entry *ret = frame_list[fifo_pos];
-  frame_list[fifo_pos] = new_page;
-  fifo_pos = (fifo_pos + 1) % cmdline_args.num_frames;
-  return ret;
+  window.num_windows++;
+  window.start = accesses_done;
+  while (window.next_end <= accesses_done) {
+    window.next_end += cmdline_args.window_size;
+  }
+  window.num_misses = stats.num_misses;
+  window.num_writes = stats.num_writes;
+  window.num_drops = stats.num_drops;
 }
 
-int max(int a, int b) { return a >= b ? a : b; }
-
-struct page_table_entry *evict_page_opt(struct page_table_entry *new_page) {
-  // Initially missing_frame = 0 ^ 1 ^ 2 ^ ... ^ (num_frames - 1)
-  // For each frame i accessed we do missing_frame ^= i
-  // When (num_frames - 1) frames are accessed, missing_frame would contain
-  // index of the frame which wasn't accessed
+void finish_windows(long accesses_done) {
+  if (accesses_done > window.start) {
+    end_window(accesses_done);
+  }
+  if (cmdline_args.window_json) {
+    fprintf(cmdline_args.window_file, "\n]\n");
+  }
+  if (fclose(cmdline_args.window_file)) {
+    perror("fclose");
+  }
+}
 
-  int missing_frame = 0;
-  for (int i = 0; i < cmdline_args.num_frames; i++) {
-    missing_frame ^= i;
+struct packed_memory_op *condensed_mem_accesses;
+long num_condensed_accesses;
+struct long_run *long_runs; // Sorted by index
+long num_long_runs;
+
+struct condensed_memory_op condensed_access(long index) {
+  struct packed_memory_op packed = condensed_mem_accesses[index];
+  struct condensed_memory_op op = {.page_num = packed.page_num,
+                                   .read = packed.read,
+                                   .write = packed.write,
+                                   .num_accesses = packed.num_accesses};
+  if (op.num_accesses == LONG_RUN) {
+    long lo = 0, hi = num_long_runs - 1;
+    while (lo < hi) {
+      long mid = (lo + hi) / 2;
+      if (long_runs[mid].index < index) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    op.num_accesses = long_runs[lo].num_accesses;
   }
+  return op;
+}
+long accesses_done = 0; // Number of memory accesses simulated
+long curr_access; // Index of the access being simulated
+int curr_page;    // Page it accesses
 
-  bool accessed[cmdline_args.num_frames];
-  memset(accessed, 0, sizeof(accessed));
+struct page_table_entry **frame_list;
 
-  int num_frames_accessed = 0;
+// A page replacement policy. The simulator tells it about every access to a
+// page in memory and every page brought in from the disk, and asks it which
+// frame to evict once all the frames are full. Everything the policy needs to
+// remember lives in the state returned by init, which is passed back to all
+// the other functions.
+struct snapshot;
+
+struct policy {
+  const char *name;
+  void *(*init)(int num_frames);
+  // Page in pte was accessed while it was in memory. May be NULL.
+  void (*on_access)(void *state, struct page_table_entry *pte);
+  // Page in pte was just brought in from the disk into pte->frame_num. Called
+  // after evict when a page had to be evicted for it. May be NULL.
+  void (*on_fault)(void *state, struct page_table_entry *pte);
+  // All the frames are full. Returns the frame to evict to bring in new_page.
+  int (*evict)(void *state, struct page_table_entry *new_page);
+  void (*cleanup)(void *state);
+  // The access at index is now known, but it'll only be simulated once it is
+  // out of the lookahead window. May be NULL, in which case no accesses are
+  // kept waiting for it.
+  void (*on_future_access)(void *state, int page_num, long index);
+  // Saves the state to snap, or loads it from snap into a state just returned
+  // by init. May be NULL if there's nothing to save.
+  void (*snapshot)(void *state, struct snapshot *snap);
+};
 
-  for (int i = curr_access; i < num_condensed_accesses; i++) {
-    if (num_frames_accessed == cmdline_args.num_frames - 1) {
-      struct page_table_entry *ret = frame_list[missing_frame];
-      frame_list[missing_frame] = new_page;
-      return ret;
-    }
+void *policy_state;
 
-    struct page_table_entry *pte =
-        &page_table[condensed_mem_accesses[i].page_num];
-    if (pte->valid && !accessed[pte->frame_num]) {
-      num_frames_accessed++;
-      missing_frame ^= pte->frame_num;
-      accessed[pte->frame_num] = true;
-    }
+void *alloc_or_die(size_t size) {
+  void *ptr = calloc(1, size);
+  if (!ptr) {
+    perror("Allocating policy state");
+    exit(1);
   }
+  return ptr;
+}
 
-  // There are more than one frames which aren't accessed anywhere in the
-  // future, so we'll evict the one with minimum frame number
-  counted_till = cmdline_args.num_frames - 1;
-  for (int i = 0; i < cmdline_args.num_frames; i++) {
-    if (!accessed[i]) {
-      struct page_table_entry *ret = frame_list[i];
-      frame_list[i] = new_page;
-      return ret;
-    }
+// Allocates an array with an int for each virtual page, all set to value
+int *alloc_page_array(int value) {
+  int *arr = alloc_or_die(num_pages * sizeof(int));
+  for (int i = 0; i < num_pages; i++) {
+    arr[i] = value;
   }
-
-  assert(0 && "The code should never reach here");
+  return arr;
 }
 
-int clock_hand = 0;
-struct page_table_entry *evict_page_clock(struct page_table_entry *new_page) {
-  int begin = clock_hand;
-  do {
-    if (frame_list[clock_hand]->use) {
-      frame_list[clock_hand]->use = false;
-      clock_hand = (clock_hand + 1) % cmdline_args.num_frames;
-      continue;
-    }
-
-    struct page_table_entry *ret = frame_list[clock_hand];
-    frame_list[clock_hand] = new_page;
-    new_page->use = true;
-    clock_hand = (clock_hand + 1) % cmdline_args.num_frames;
-    return ret;
-  } while (begin != clock_hand);
+// Doubly linked list of page numbers. The links are stored in arrays indexed
+// by page number, which can be shared by lists a page can't be in at the same
+// time.
+struct page_list {
+  int head, tail, size;
+  int *prev, *next;
+};
 
-  // begin == clock_hand ^ all pages had use bit set
-  struct page_table_entry *ret = frame_list[clock_hand];
-  frame_list[clock_hand] = new_page;
-  new_page->use = true;
-  clock_hand = (clock_hand + 1) % cmdline_args.num_frames;
-  return ret;
+void page_list_init(struct page_list *list, int *prev, int *next) {
+  *list = (struct page_list){
+      .head = -1, .tail = -1, .size = 0, .prev = prev, .next = next};
 }
 
-struct page_table_entry *evict_page_lru(struct page_table_entry *new_page) {
-  int min_used_at = frame_list[0]->used_at;
-  int min_index = 0;
-  for (int i = 1; i < cmdline_args.num_frames; i++) {
-    if (frame_list[i]->used_at < min_used_at) {
-      min_used_at = frame_list[i]->used_at;
-      min_index = i;
-    }
+// Inserts page_num before the page `before`, or at the tail if it is -1
+void page_list_insert_before(struct page_list *list, int page_num,
+                             int before) {
+  int after = before == -1 ? list->tail : list->prev[before];
+  list->prev[page_num] = after;
+  list->next[page_num] = before;
+  if (after == -1) {
+    list->head = page_num;
+  } else {
+    list->next[after] = page_num;
+  }
+  if (before == -1) {
+    list->tail = page_num;
+  } else {
+    list->prev[before] = page_num;
   }
-  struct page_table_entry *ret = frame_list[min_index];
-  frame_list[min_index] = new_page;
-  return ret;
+  list->size++;
+}
+
+void page_list_push_front(struct page_list *list, int page_num) {
+  page_list_insert_before(list, page_num, list->head);
 }
 
-struct page_table_entry *evict_page_random(struct page_table_entry *new_page) {
-  int frame_num = rand() % cmdline_args.num_frames;
-  struct page_table_entry *ret = frame_list[frame_num];
-  frame_list[frame_num] = new_page;
-  return ret;
+void page_list_push_back(struct page_list *list, int page_num) {
+  page_list_insert_before(list, page_num, -1);
 }
 
-struct page_table_entry *get_page_evict(struct page_table_entry *new_page) {
-  switch (cmdline_args.strategy) {
-  case OPT:
-    return evict_page_opt(new_page);
-  case FIFO:
-    return evict_page_fifo(new_page);
-  case CLOCK:
-    return evict_page_clock(new_page);
-  case LRU:
-    return evict_page_lru(new_page);
-  case RANDOM:
-    return evict_page_random(new_page);
+void page_list_remove(struct page_list *list, int page_num) {
+  int prev = list->prev[page_num], next = list->next[page_num];
+  if (prev == -1) {
+    list->head = next;
+  } else {
+    list->next[prev] = next;
+  }
+  if (next == -1) {
+    list->tail = prev;
+  } else {
+    list->prev[next] = prev;
   }
-  fprintf(stderr, "Unrecognized strategy\n");
-  exit(1);
+  list->size--;
 }
 
-void print_verbose(int written_page, int read_page, bool dirty) {
-  if (!cmdline_args.verbose)
+int frame_of(int page_num) { return page_table[page_num].frame_num; }
+
+// Checkpoints are written and read by the same code, which transfers
+// everything through snapshot_data in one direction or the other
+struct snapshot {
+  FILE *file;
+  bool saving;
+};
+
+void snapshot_data(struct snapshot *snap, void *data, size_t size) {
+  if (size == 0) {
     return;
-  if (dirty) {
-    printf("Page 0x%05x was read from disk, page 0x%05x was written to the "
-           "disk.\n",
-           read_page, written_page);
-  } else {
-    printf(
-        "Page 0x%05x was read from disk, page 0x%05x was dropped (it was not "
-        "dirty).\n",
-        read_page, written_page);
+  }
+  size_t done = snap->saving ? fwrite(data, 1, size, snap->file)
+                             : fread(data, 1, size, snap->file);
+  if (done != size) {
+    fprintf(stderr, snap->saving ? "Writing checkpoint failed\n"
+                                 : "Checkpoint is truncated\n");
+    exit(1);
   }
 }
 
-void get_page_from_disk(struct page_table_entry *pte) {
-  stats.num_misses++;
+#define SNAPSHOT_FIELD(snap, field) snapshot_data(snap, &(field), sizeof(field))
 
-  if (next_free_frame < cmdline_args.num_frames) {
-    pte->frame_num = next_free_frame++;
-  } else {
-    // Need to evict
-    struct page_table_entry *pte_evict = get_page_evict(pte);
-    assert(pte_evict->valid &&
-           "Page to evict must be in memory in the first place");
-    pte_evict->valid = false;
-    if (pte_evict->dirty) {
-      stats.num_writes++;
-    } else {
-      stats.num_drops++;
-    }
-    pte->frame_num = pte_evict->frame_num;
-    print_verbose(pte_evict->page_num, pte->page_num, pte_evict->dirty);
+// Only the ends and size, the links are in arrays snapshotted separately
+void snapshot_page_list(struct snapshot *snap, struct page_list *list) {
+  SNAPSHOT_FIELD(snap, list->head);
+  SNAPSHOT_FIELD(snap, list->tail);
+  SNAPSHOT_FIELD(snap, list->size);
+}
+
+/* -------------------------------- FIFO --------------------------------- */
+
+struct fifo_state {
+  int num_frames;
+  int pos; // Frame which was filled the earliest
+};
+
+void *fifo_init(int num_frames) {
+  struct fifo_state *s = alloc_or_die(sizeof(*s));
+  s->num_frames = num_frames;
+  return s;
+}
+
+int fifo_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct fifo_state *s = state;
+  int frame_num = s->pos;
+  s->pos = (s->pos + 1) % s->num_frames;
+  return frame_num;
+}
+
+void fifo_snapshot(void *state, struct snapshot *snap) {
+  snapshot_data(snap, state, sizeof(struct fifo_state));
+}
+
+/* -------------------------------- RANDOM -------------------------------- */
+
+struct random_state {
+  int num_frames;
+};
+
+long num_random_draws; // Numbers drawn from rand(), by all instances
+
+void *random_init(int num_frames) {
+  struct random_state *s = alloc_or_die(sizeof(*s));
+  s->num_frames = num_frames;
+  return s;
+}
+
+int random_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct random_state *s = state;
+  num_random_draws++;
+  return rand() % s->num_frames;
+}
+
+/* --------------------------------- OPT ---------------------------------- */
+
+// Frames are kept in a max-heap keyed on when they will be used next, so the
+// frame to evict is always at the top. Pages which aren't used again, or not
+// within the lookahead window when streaming, all have the key LONG_MAX, among
+// them the one with minimum frame number is evicted.
+//
+// OPT is told about each access when it enters the window (the whole trace
+// unless streaming), at which point it becomes the next use of the previous
+// access to the same page.
+struct opt_state {
+  int num_frames;
+  long window; // Number of accesses next_use has room for
+  // next_use[i % window] is the index of the next access to the page accessed
+  // at index i, or LONG_MAX if there's no such access in the window yet
+  long *next_use;
+  long *last_seen; // Index of the latest access to each page in the window
+  // Index of the earliest access to each page still to be simulated, valid
+  // only if last_seen is at least curr_access
+  long *first_pending;
+  int *heap;       // Heap of frame numbers
+  int *heap_pos;   // Index of each frame in heap
+  long *frame_key; // Next use of the page in each frame
+};
+
+void opt_on_future_access(void *state, int page_num, long index);
+
+void *opt_init(int num_frames) {
+  struct opt_state *s = alloc_or_die(sizeof(*s));
+  s->num_frames = num_frames;
+  s->window = cmdline_args.streaming ? cmdline_args.lookahead + 1
+                                     : lmax(num_condensed_accesses, 1);
+  s->next_use = alloc_or_die(s->window * sizeof(long));
+  s->last_seen = alloc_or_die(num_pages * sizeof(long));
+  s->first_pending = alloc_or_die(num_pages * sizeof(long));
+  for (int i = 0; i < num_pages; i++) {
+    s->last_seen[i] = -1;
   }
 
-  frame_list[pte->frame_num] = pte;
-  pte->dirty = false;
-  pte->valid = true;
+  // Every frame starts in the heap. Their keys don't matter since nothing is
+  // evicted before all the frames are filled.
+  s->heap = alloc_or_die(num_frames * sizeof(int));
+  s->heap_pos = alloc_or_die(num_frames * sizeof(int));
+  s->frame_key = alloc_or_die(num_frames * sizeof(long));
+  for (int i = 0; i < num_frames; i++) {
+    s->heap[i] = s->heap_pos[i] = i;
+  }
+
+  if (!cmdline_args.streaming) {
+    for (long i = 0; i < num_condensed_accesses; i++) {
+      opt_on_future_access(s, condensed_mem_accesses[i].page_num, i);
+    }
+  }
+  return s;
 }
 
-void perform_read(struct page_table_entry *pte) {
-  if (pte->valid) {
-    return;
+bool opt_before(struct opt_state *s, int frame_a, int frame_b) {
+  if (s->frame_key[frame_a] != s->frame_key[frame_b]) {
+    return s->frame_key[frame_a] > s->frame_key[frame_b];
   }
+  return frame_a < frame_b;
+}
 
-  // Translation not valid, need to bring page from disk.
-  get_page_from_disk(pte);
-  perform_read(pte);
+void opt_heap_swap(struct opt_state *s, int i, int j) {
+  int tmp = s->heap[i];
+  s->heap[i] = s->heap[j];
+  s->heap[j] = tmp;
+  s->heap_pos[s->heap[i]] = i;
+  s->heap_pos[s->heap[j]] = j;
 }
 
-void perform_write(struct page_table_entry *pte) {
-  if (pte->valid) {
-    pte->dirty = true;
+// Key of a frame only ever increases since accesses only move forward, but
+// sift both ways to not depend on that.
+void opt_set_key(struct opt_state *s, int frame_num, long key) {
+  s->frame_key[frame_num] = key;
+  int i = s->heap_pos[frame_num];
+  while (i > 0 && opt_before(s, s->heap[i], s->heap[(i - 1) / 2])) {
+    opt_heap_swap(s, i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+  while (true) {
+    int largest = i;
+    int left = 2 * i + 1, right = 2 * i + 2;
+    if (left < s->num_frames && opt_before(s, s->heap[left], s->heap[largest])) {
+      largest = left;
+    }
+    if (right < s->num_frames &&
+        opt_before(s, s->heap[right], s->heap[largest])) {
+      largest = right;
+    }
+    if (largest == i) {
+      break;
+    }
+    opt_heap_swap(s, i, largest);
+    i = largest;
+  }
+}
+
+void opt_on_access(void *state, struct page_table_entry *pte) {
+  struct opt_state *s = state;
+  int page_num = pte->page_num;
+  if (page_num == curr_page) {
+    long next = s->next_use[curr_access % s->window];
+    s->first_pending[page_num] = next;
+    opt_set_key(s, pte->frame_num, next);
     return;
   }
 
-  // Translation not valid, need to bring page from disk.
-  get_page_from_disk(pte);
-  perform_write(pte);
+  // Brought in without being accessed
+  bool pending = s->last_seen[page_num] >= curr_access;
+  opt_set_key(s, pte->frame_num,
+              pending ? s->first_pending[page_num] : LONG_MAX);
 }
 
-void perform_op(struct condensed_memory_op op, int access_idx) {
-  assert(op.page_num < (1 << VPN_BITS) && op.page_num >= 0 &&
-         "Virtual Page Number must fit into the bits reserved for it");
-
-  struct page_table_entry *pte = &page_table[op.page_num];
-  count_access(pte, access_idx);
-  pte->page_num = op.page_num;
-  if (op.read) {
-    perform_read(pte);
+void opt_on_future_access(void *state, int page_num, long index) {
+  struct opt_state *s = state;
+  s->next_use[index % s->window] = LONG_MAX;
+  long last = s->last_seen[page_num];
+  s->last_seen[page_num] = index;
+  if (last >= curr_access) {
+    // Previous access is still to be simulated
+    s->next_use[last % s->window] = index;
+    return;
   }
-  if (op.write) {
-    perform_write(pte);
+
+  s->first_pending[page_num] = index;
+  if (page_table[page_num].valid) {
+    // Page is in memory and was thought not to be used again
+    opt_set_key(s, page_table[page_num].frame_num, index);
   }
 }
 
-void init() {
-  srand(5635);
-  frame_list =
-      malloc(cmdline_args.num_frames * sizeof(struct page_table_entry *));
-  page_table = malloc((1 << VPN_BITS) * sizeof(struct page_table_entry));
-  memset(page_table, 0, (1 << VPN_BITS) * sizeof(struct page_table_entry));
+int opt_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct opt_state *s = state;
+  return s->heap[0];
 }
 
-void cleanup() {
-  free(frame_list);
-  free(page_table);
-  if (fclose(cmdline_args.input_file)) {
-    perror("fclose");
-  }
+void opt_cleanup(void *state) {
+  struct opt_state *s = state;
+  free(s->next_use);
+  free(s->last_seen);
+  free(s->first_pending);
+  free(s->heap);
+  free(s->heap_pos);
+  free(s->frame_key);
+  free(s);
 }
 
-int main(int argc, char *argv[]) {
-  cmdline_args = extract_cmdline_args(argc, argv);
+// next_use and last_seen only depend on the trace, and init has gone through
+// it already
+void opt_snapshot(void *state, struct snapshot *snap) {
+  struct opt_state *s = state;
+  snapshot_data(snap, s->first_pending, num_pages * sizeof(long));
+  snapshot_data(snap, s->heap, s->num_frames * sizeof(int));
+  snapshot_data(snap, s->heap_pos, s->num_frames * sizeof(int));
+  snapshot_data(snap, s->frame_key, s->num_frames * sizeof(long));
+}
 
-  init();
+/* -------------------------------- CLOCK --------------------------------- */
 
-  int num_accesses = 0;
-  struct memory_op *mem_accesses =
-      get_all_accesses(cmdline_args.input_file, &num_accesses);
-  stats.mem_accesses = num_accesses;
+struct clock_state {
+  int num_frames;
+  int hand;
+  // Use bits, one per frame. Keeping them packed lets the hand skip over 64
+  // frames at a time.
+  uint64_t *use_bits;
+};
 
-  num_condensed_accesses = 0;
-  condensed_mem_accesses =
-      condense_accesses(mem_accesses, num_accesses, &num_condensed_accesses);
-  free(mem_accesses);
+void *clock_init(int num_frames) {
+  struct clock_state *s = alloc_or_die(sizeof(*s));
+  s->num_frames = num_frames;
+  s->use_bits = alloc_or_die((num_frames + 63) / 64 * sizeof(uint64_t));
+  return s;
+}
 
-  for (curr_access = 0; curr_access < num_condensed_accesses; curr_access++) {
-    perform_op(condensed_mem_accesses[curr_access], curr_access);
-  }
-  print_stats();
+void clock_on_access(void *state, struct page_table_entry *pte) {
+  struct clock_state *s = state;
+  s->use_bits[pte->frame_num / 64] |= 1ULL << (pte->frame_num % 64);
+}
 
-  free(condensed_mem_accesses);
+// Clears use bits from the hand onwards till a frame with the use bit unset
+// is found and returns it. If all the use bits are set, they all get cleared
+// and the frame at the hand itself is returned.
+int clock_find_victim(struct clock_state *s) {
+  int num_words = (s->num_frames + 63) / 64;
+  int word = s->hand / 64;
+  uint64_t mask = ~0ULL << (s->hand % 64);
+
+  for (int scanned = 0; scanned <= num_words; scanned++) {
+    // Bits past the last frame are never set, so they'd look like free
+    // victims. Mask them out.
+    uint64_t valid = mask;
+    if (word == num_words - 1 && s->num_frames % 64) {
+      valid &= (1ULL << (s->num_frames % 64)) - 1;
+    }
+    uint64_t unused = ~s->use_bits[word] & valid;
+    if (unused) {
+      int bit = __builtin_ctzll(unused);
+      // All the frames skipped over in this word had the use bit set
+      s->use_bits[word] &= ~(valid & ((1ULL << bit) - 1));
+      return word * 64 + bit;
+    }
+    s->use_bits[word] &= ~valid;
+    word = (word + 1) % num_words;
+    mask = ~0ULL;
+  }
+
+  return s->hand;
+}
+
+int clock_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct clock_state *s = state;
+  int frame_num = clock_find_victim(s);
+  s->hand = (frame_num + 1) % s->num_frames;
+  return frame_num;
+}
+
+void clock_cleanup(void *state) {
+  struct clock_state *s = state;
+  free(s->use_bits);
+  free(s);
+}
+
+void clock_snapshot(void *state, struct snapshot *snap) {
+  struct clock_state *s = state;
+  SNAPSHOT_FIELD(snap, s->hand);
+  snapshot_data(snap, s->use_bits,
+                (s->num_frames + 63) / 64 * sizeof(uint64_t));
+}
+
+/* --------------------------------- LRU ---------------------------------- */
+
+// Frames in order of recency as a doubly linked list, most recently used at
+// the head.
+struct lru_state {
+  int num_frames;
+  int *prev, *next;
+  int head, tail;
+};
+
+void *lru_init(int num_frames) {
+  struct lru_state *s = alloc_or_die(sizeof(*s));
+  s->num_frames = num_frames;
+  // All frames start in the list, and each gets moved to the front when it's
+  // filled.
+  s->prev = alloc_or_die(num_frames * sizeof(int));
+  s->next = alloc_or_die(num_frames * sizeof(int));
+  for (int i = 0; i < num_frames; i++) {
+    s->prev[i] = i - 1;
+    s->next[i] = i + 1 < num_frames ? i + 1 : -1;
+  }
+  s->head = 0;
+  s->tail = num_frames - 1;
+  return s;
+}
+
+void lru_on_access(void *state, struct page_table_entry *pte) {
+  struct lru_state *s = state;
+  int frame_num = pte->frame_num;
+  if (frame_num == s->head) {
+    return;
+  }
+
+  // Unlink. frame_num isn't the head so it has a previous frame.
+  s->next[s->prev[frame_num]] = s->next[frame_num];
+  if (frame_num == s->tail) {
+    s->tail = s->prev[frame_num];
+  } else {
+    s->prev[s->next[frame_num]] = s->prev[frame_num];
+  }
+
+  s->prev[frame_num] = -1;
+  s->next[frame_num] = s->head;
+  s->prev[s->head] = frame_num;
+  s->head = frame_num;
+}
+
+int lru_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct lru_state *s = state;
+  return s->tail;
+}
+
+void lru_cleanup(void *state) {
+  struct lru_state *s = state;
+  free(s->prev);
+  free(s->next);
+  free(s);
+}
+
+void lru_snapshot(void *state, struct snapshot *snap) {
+  struct lru_state *s = state;
+  snapshot_data(snap, s->prev, s->num_frames * sizeof(int));
+  snapshot_data(snap, s->next, s->num_frames * sizeof(int));
+  SNAPSHOT_FIELD(snap, s->head);
+  SNAPSHOT_FIELD(snap, s->tail);
+}
+
+/* --------------------------------- ARC ---------------------------------- */
+
+// Adaptive Replacement Cache (Megiddo & Modha). T1 holds pages seen once
+// recently and T2 pages seen at least twice, B1 and B2 remember pages recently
+// evicted from them. A hit in B1 or B2 grows the target size p of T1 or T2
+// respectively.
+enum arc_list { ARC_NONE, ARC_T1, ARC_T2, ARC_B1, ARC_B2 };
+
+struct arc_state {
+  int c; // Number of frames
+  int p; // Target size of T1
+  struct page_list lists[5];
+  int *prev, *next;
+  char *where; // Which list each page is in
+};
+
+void *arc_init(int num_frames) {
+  struct arc_state *s = alloc_or_die(sizeof(*s));
+  s->c = num_frames;
+  s->prev = alloc_page_array(-1);
+  s->next = alloc_page_array(-1);
+  s->where = alloc_or_die(num_pages);
+  for (int i = ARC_T1; i <= ARC_B2; i++) {
+    page_list_init(&s->lists[i], s->prev, s->next);
+  }
+  return s;
+}
+
+void arc_move(struct arc_state *s, int page_num, enum arc_list to) {
+  if (s->where[page_num] != ARC_NONE) {
+    page_list_remove(&s->lists[(int)s->where[page_num]], page_num);
+  }
+  s->where[page_num] = to;
+  if (to != ARC_NONE) {
+    page_list_push_front(&s->lists[to], page_num);
+  }
+}
+
+void arc_on_access(void *state, struct page_table_entry *pte) {
+  arc_move(state, pte->page_num, ARC_T2);
+}
+
+// REPLACE from the paper. Moves the LRU page of T1 or T2 to its ghost list and
+// returns its frame.
+int arc_replace(struct arc_state *s, bool in_b2) {
+  int t1_size = s->lists[ARC_T1].size;
+  int victim;
+  if (t1_size >= 1 &&
+      ((in_b2 && t1_size == s->p) || t1_size > s->p ||
+       s->lists[ARC_T2].size == 0)) {
+    victim = s->lists[ARC_T1].tail;
+    arc_move(s, victim, ARC_B1);
+  } else {
+    victim = s->lists[ARC_T2].tail;
+    arc_move(s, victim, ARC_B2);
+  }
+  return frame_of(victim);
+}
+
+int arc_evict(void *state, struct page_table_entry *new_page) {
+  struct arc_state *s = state;
+  int page_num = new_page->page_num;
+  int b1_size = s->lists[ARC_B1].size, b2_size = s->lists[ARC_B2].size;
+
+  if (s->where[page_num] == ARC_B1) {
+    s->p = min(s->c, s->p + max(b2_size / b1_size, 1));
+    return arc_replace(s, false);
+  }
+  if (s->where[page_num] == ARC_B2) {
+    s->p = max(0, s->p - max(b1_size / b2_size, 1));
+    return arc_replace(s, true);
+  }
+
+  // Page isn't in the directory at all
+  int t1_size = s->lists[ARC_T1].size;
+  if (t1_size + b1_size == s->c) {
+    if (t1_size < s->c) {
+      arc_move(s, s->lists[ARC_B1].tail, ARC_NONE);
+      return arc_replace(s, false);
+    }
+    // B1 is empty, evict the LRU page of T1 without remembering it
+    int victim = s->lists[ARC_T1].tail;
+    arc_move(s, victim, ARC_NONE);
+    return frame_of(victim);
+  }
+  if (s->c + b1_size + b2_size == 2 * s->c) {
+    arc_move(s, s->lists[ARC_B2].tail, ARC_NONE);
+  }
+  return arc_replace(s, false);
+}
+
+void arc_on_fault(void *state, struct page_table_entry *pte) {
+  struct arc_state *s = state;
+  int page_num = pte->page_num;
+  if (s->where[page_num] == ARC_B1 || s->where[page_num] == ARC_B2) {
+    arc_move(s, page_num, ARC_T2);
+  } else {
+    arc_move(s, page_num, ARC_T1);
+  }
+}
+
+void arc_cleanup(void *state) {
+  struct arc_state *s = state;
+  free(s->prev);
+  free(s->next);
+  free(s->where);
+  free(s);
+}
+
+void arc_snapshot(void *state, struct snapshot *snap) {
+  struct arc_state *s = state;
+  SNAPSHOT_FIELD(snap, s->p);
+  for (int i = ARC_T1; i <= ARC_B2; i++) {
+    snapshot_page_list(snap, &s->lists[i]);
+  }
+  snapshot_data(snap, s->prev, num_pages * sizeof(int));
+  snapshot_data(snap, s->next, num_pages * sizeof(int));
+  snapshot_data(snap, s->where, num_pages);
+}
+
+/* ---------------------------------- 2Q ---------------------------------- */
+
+// Full 2Q (Johnson & Shasha). New pages go into the FIFO A1in. When they're
+// evicted from there they're remembered in A1out, and only a page faulted on
+// while it is in A1out is put in the LRU list Am. So a page has to be
+// accessed again after a while to be kept for long, which makes the policy
+// resistant to scans.
+enum two_q_list { TWO_Q_NONE, TWO_Q_A1IN, TWO_Q_A1OUT, TWO_Q_AM };
+
+struct two_q_state {
+  int k_in;  // Size A1in is allowed to grow to before it's evicted from
+  int k_out; // Maximum size of A1out
+  struct page_list lists[4];
+  int *prev, *next;
+  char *where; // Which list each page is in
+};
+
+void *two_q_init(int num_frames) {
+  struct two_q_state *s = alloc_or_die(sizeof(*s));
+  // Sizes recommended by the paper
+  s->k_in = num_frames / 4;
+  s->k_out = max(num_frames / 2, 1);
+  s->prev = alloc_page_array(-1);
+  s->next = alloc_page_array(-1);
+  s->where = alloc_or_die(num_pages);
+  for (int i = TWO_Q_A1IN; i <= TWO_Q_AM; i++) {
+    page_list_init(&s->lists[i], s->prev, s->next);
+  }
+  return s;
+}
+
+void two_q_move(struct two_q_state *s, int page_num, enum two_q_list to) {
+  if (s->where[page_num] != TWO_Q_NONE) {
+    page_list_remove(&s->lists[(int)s->where[page_num]], page_num);
+  }
+  s->where[page_num] = to;
+  if (to != TWO_Q_NONE) {
+    page_list_push_front(&s->lists[to], page_num);
+  }
+}
+
+void two_q_on_access(void *state, struct page_table_entry *pte) {
+  struct two_q_state *s = state;
+  // Hits in A1in are deliberately ignored
+  if (s->where[pte->page_num] == TWO_Q_AM) {
+    two_q_move(s, pte->page_num, TWO_Q_AM);
+  }
+}
+
+int two_q_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct two_q_state *s = state;
+  struct page_list *a1in = &s->lists[TWO_Q_A1IN], *am = &s->lists[TWO_Q_AM];
+  if (a1in->size > s->k_in || am->size == 0) {
+    int victim = a1in->tail;
+    two_q_move(s, victim, TWO_Q_A1OUT);
+    if (s->lists[TWO_Q_A1OUT].size > s->k_out) {
+      two_q_move(s, s->lists[TWO_Q_A1OUT].tail, TWO_Q_NONE);
+    }
+    return frame_of(victim);
+  }
+
+  int victim = am->tail;
+  two_q_move(s, victim, TWO_Q_NONE);
+  return frame_of(victim);
+}
+
+void two_q_on_fault(void *state, struct page_table_entry *pte) {
+  struct two_q_state *s = state;
+  if (s->where[pte->page_num] == TWO_Q_A1OUT) {
+    two_q_move(s, pte->page_num, TWO_Q_AM);
+  } else {
+    two_q_move(s, pte->page_num, TWO_Q_A1IN);
+  }
+}
+
+void two_q_cleanup(void *state) {
+  struct two_q_state *s = state;
+  free(s->prev);
+  free(s->next);
+  free(s->where);
+  free(s);
+}
+
+void two_q_snapshot(void *state, struct snapshot *snap) {
+  struct two_q_state *s = state;
+  for (int i = TWO_Q_A1IN; i <= TWO_Q_AM; i++) {
+    snapshot_page_list(snap, &s->lists[i]);
+  }
+  snapshot_data(snap, s->prev, num_pages * sizeof(int));
+  snapshot_data(snap, s->next, num_pages * sizeof(int));
+  snapshot_data(snap, s->where, num_pages);
+}
+
+/* --------------------------------- LIRS --------------------------------- */
+
+// Low Inter-reference Recency Set (Jiang & Zhang). Most frames hold LIR pages,
+// ones whose last two accesses were close together. The rest hold HIR pages,
+// which are queued in Q and are the only ones evicted. The recency stack S
+// holds all LIR pages along with HIR pages (possibly evicted) accessed more
+// recently than the oldest LIR page. An HIR page accessed again while it is
+// still in S has a shorter reuse distance than the oldest LIR page, so the two
+// swap status.
+enum lirs_status { LIRS_NONE, LIRS_LIR, LIRS_HIR, LIRS_HIR_NONRESIDENT };
+
+struct lirs_state {
+  int max_lir; // Number of frames for LIR pages
+  int num_lir;
+  struct page_list stack, queue; // S and Q. A page can be in both.
+  int *stack_prev, *stack_next, *queue_prev, *queue_next;
+  char *status;
+  bool *in_stack;
+};
+
+void *lirs_init(int num_frames) {
+  struct lirs_state *s = alloc_or_die(sizeof(*s));
+  // The paper suggests using 1% of the frames for HIR pages
+  s->max_lir = num_frames - max(num_frames / 100, 1);
+  s->stack_prev = alloc_page_array(-1);
+  s->stack_next = alloc_page_array(-1);
+  s->queue_prev = alloc_page_array(-1);
+  s->queue_next = alloc_page_array(-1);
+  s->status = alloc_or_die(num_pages);
+  s->in_stack = alloc_or_die(num_pages * sizeof(bool));
+  page_list_init(&s->stack, s->stack_prev, s->stack_next);
+  page_list_init(&s->queue, s->queue_prev, s->queue_next);
+  return s;
+}
+
+void lirs_push_stack(struct lirs_state *s, int page_num) {
+  if (s->in_stack[page_num]) {
+    page_list_remove(&s->stack, page_num);
+  }
+  page_list_push_front(&s->stack, page_num);
+  s->in_stack[page_num] = true;
+}
+
+// Removes HIR pages from the bottom of S so that the bottom is an LIR page
+void lirs_prune(struct lirs_state *s) {
+  while (s->stack.size && s->status[s->stack.tail] != LIRS_LIR) {
+    int page_num = s->stack.tail;
+    page_list_remove(&s->stack, page_num);
+    s->in_stack[page_num] = false;
+    if (s->status[page_num] == LIRS_HIR_NONRESIDENT) {
+      s->status[page_num] = LIRS_NONE;
+    }
+  }
+}
+
+// page_num must be on top of S. Makes it LIR, turning the LIR pages at the
+// bottom of S into HIR ones if there are too many.
+void lirs_make_lir(struct lirs_state *s, int page_num) {
+  s->status[page_num] = LIRS_LIR;
+  s->num_lir++;
+  while (s->num_lir > s->max_lir) {
+    lirs_prune(s);
+    int bottom = s->stack.tail;
+    s->status[bottom] = LIRS_HIR;
+    s->num_lir--;
+    page_list_remove(&s->stack, bottom);
+    s->in_stack[bottom] = false;
+    page_list_push_back(&s->queue, bottom);
+  }
+  lirs_prune(s);
+}
+
+void lirs_on_access(void *state, struct page_table_entry *pte) {
+  struct lirs_state *s = state;
+  int page_num = pte->page_num;
+
+  if (s->status[page_num] == LIRS_LIR) {
+    bool was_bottom = s->stack.tail == page_num;
+    lirs_push_stack(s, page_num);
+    if (was_bottom) {
+      lirs_prune(s);
+    }
+    return;
+  }
+
+  // Resident HIR page
+  page_list_remove(&s->queue, page_num);
+  if (s->in_stack[page_num]) {
+    lirs_push_stack(s, page_num);
+    lirs_make_lir(s, page_num);
+  } else {
+    lirs_push_stack(s, page_num);
+    page_list_push_back(&s->queue, page_num);
+  }
+}
+
+int lirs_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct lirs_state *s = state;
+  int victim = s->queue.head;
+  page_list_remove(&s->queue, victim);
+  s->status[victim] = s->in_stack[victim] ? LIRS_HIR_NONRESIDENT : LIRS_NONE;
+  return frame_of(victim);
+}
+
+void lirs_on_fault(void *state, struct page_table_entry *pte) {
+  struct lirs_state *s = state;
+  int page_num = pte->page_num;
+
+  lirs_push_stack(s, page_num);
+  if (s->status[page_num] == LIRS_HIR_NONRESIDENT ||
+      s->num_lir < s->max_lir) {
+    lirs_make_lir(s, page_num);
+  } else {
+    s->status[page_num] = LIRS_HIR;
+    page_list_push_back(&s->queue, page_num);
+  }
+}
+
+void lirs_cleanup(void *state) {
+  struct lirs_state *s = state;
+  free(s->stack_prev);
+  free(s->stack_next);
+  free(s->queue_prev);
+  free(s->queue_next);
+  free(s->status);
+  free(s->in_stack);
+  free(s);
+}
+
+void lirs_snapshot(void *state, struct snapshot *snap) {
+  struct lirs_state *s = state;
+  SNAPSHOT_FIELD(snap, s->num_lir);
+  snapshot_page_list(snap, &s->stack);
+  snapshot_page_list(snap, &s->queue);
+  snapshot_data(snap, s->stack_prev, num_pages * sizeof(int));
+  snapshot_data(snap, s->stack_next, num_pages * sizeof(int));
+  snapshot_data(snap, s->queue_prev, num_pages * sizeof(int));
+  snapshot_data(snap, s->queue_next, num_pages * sizeof(int));
+  snapshot_data(snap, s->status, num_pages);
+  snapshot_data(snap, s->in_stack, num_pages * sizeof(bool));
+}
+
+/* ------------------------------- CLOCK-Pro ------------------------------ */
+
+// CLOCK-Pro (Jiang, Chen & Zhang), an approximation of LIRS with a clock.
+// Pages are hot or cold and all sit on one circular list, along with recently
+// evicted cold pages. A newly faulted page is cold and gets a test period, and
+// it's promoted to hot if it's accessed again during it. Three hands go around
+// the list:
+//  - hand_cold evicts cold pages without the reference bit set
+//  - hand_hot turns hot pages without the reference bit set cold
+//  - hand_test ends test periods, forgetting evicted pages in their test period
+// The number of frames for cold pages adapts: it grows when an evicted page is
+// faulted on during its test period and shrinks when a test period ends
+// without an access.
+enum clock_pro_flags {
+  CLOCK_PRO_IN_LIST = 1,
+  CLOCK_PRO_HOT = 2,
+  CLOCK_PRO_RESIDENT = 4,
+  CLOCK_PRO_REF = 8,
+  CLOCK_PRO_TEST = 16,
+};
+
+struct clock_pro_state {
+  int c;           // Number of frames
+  int cold_target; // Number of frames cold pages should get
+  int num_hot, num_cold, num_nonresident;
+  bool filled; // Whether all the frames have been filled
+  struct page_list list;
+  int *prev, *next;
+  int hand_hot, hand_cold, hand_test;
+  char *flags;
+};
+
+void *clock_pro_init(int num_frames) {
+  struct clock_pro_state *s = alloc_or_die(sizeof(*s));
+  s->c = num_frames;
+  s->cold_target = max(num_frames / 100, 1);
+  s->prev = alloc_page_array(-1);
+  s->next = alloc_page_array(-1);
+  s->flags = alloc_or_die(num_pages);
+  page_list_init(&s->list, s->prev, s->next);
+  s->hand_hot = s->hand_cold = s->hand_test = -1;
+  return s;
+}
+
+int clock_pro_next(struct clock_pro_state *s, int page_num) {
+  return s->next[page_num] == -1 ? s->list.head : s->next[page_num];
+}
+
+// Puts page_num at the head of the list, which is right behind hand_hot
+void clock_pro_insert(struct clock_pro_state *s, int page_num) {
+  s->flags[page_num] |= CLOCK_PRO_IN_LIST;
+  if (s->list.size == 0) {
+    page_list_push_back(&s->list, page_num);
+    s->hand_hot = s->hand_cold = s->hand_test = page_num;
+    return;
+  }
+  page_list_insert_before(&s->list, page_num, s->hand_hot);
+}
+
+void clock_pro_remove(struct clock_pro_state *s, int page_num) {
+  int next = s->list.size == 1 ? -1 : clock_pro_next(s, page_num);
+  if (s->hand_hot == page_num) {
+    s->hand_hot = next;
+  }
+  if (s->hand_cold == page_num) {
+    s->hand_cold = next;
+  }
+  if (s->hand_test == page_num) {
+    s->hand_test = next;
+  }
+  page_list_remove(&s->list, page_num);
+  s->flags[page_num] &= ~CLOCK_PRO_IN_LIST;
+}
+
+void clock_pro_end_test(struct clock_pro_state *s, int page_num) {
+  s->flags[page_num] &= ~CLOCK_PRO_TEST;
+  s->cold_target = max(s->cold_target - 1, 1);
+  if (!(s->flags[page_num] & CLOCK_PRO_RESIDENT)) {
+    clock_pro_remove(s, page_num);
+    s->num_nonresident--;
+  }
+}
+
+// Goes around till a hot page is turned cold, ending test periods on the way
+void clock_pro_run_hand_hot(struct clock_pro_state *s) {
+  while (true) {
+    int page_num = s->hand_hot;
+    s->hand_hot = clock_pro_next(s, page_num);
+    char flags = s->flags[page_num];
+    if (flags & CLOCK_PRO_HOT) {
+      if (flags & CLOCK_PRO_REF) {
+        s->flags[page_num] &= ~CLOCK_PRO_REF;
+        continue;
+      }
+      s->flags[page_num] &= ~CLOCK_PRO_HOT;
+      s->num_hot--;
+      s->num_cold++;
+      return;
+    }
+    if (flags & CLOCK_PRO_TEST) {
+      clock_pro_end_test(s, page_num);
+    }
+  }
+}
+
+// Goes around till the test period of an evicted page is ended
+void clock_pro_run_hand_test(struct clock_pro_state *s) {
+  while (true) {
+    int page_num = s->hand_test;
+    s->hand_test = clock_pro_next(s, page_num);
+    char flags = s->flags[page_num];
+    if (!(flags & CLOCK_PRO_HOT) && (flags & CLOCK_PRO_TEST)) {
+      clock_pro_end_test(s, page_num);
+      if (!(flags & CLOCK_PRO_RESIDENT)) {
+        return;
+      }
+    }
+  }
+}
+
+void clock_pro_make_hot(struct clock_pro_state *s, int page_num) {
+  s->flags[page_num] |= CLOCK_PRO_HOT;
+  s->num_hot++;
+  while (s->num_hot > s->c - s->cold_target) {
+    clock_pro_run_hand_hot(s);
+  }
+}
+
+void clock_pro_on_access(void *state, struct page_table_entry *pte) {
+  struct clock_pro_state *s = state;
+  s->flags[pte->page_num] |= CLOCK_PRO_REF;
+}
+
+int clock_pro_evict(void *state, struct page_table_entry *new_page) {
+  (void)new_page;
+  struct clock_pro_state *s = state;
+  s->filled = true;
+  while (true) {
+    int page_num = s->hand_cold;
+    s->hand_cold = clock_pro_next(s, page_num);
+    char flags = s->flags[page_num];
+    if ((flags & CLOCK_PRO_HOT) || !(flags & CLOCK_PRO_RESIDENT)) {
+      continue;
+    }
+
+    if (flags & CLOCK_PRO_REF) {
+      s->flags[page_num] &= ~CLOCK_PRO_REF;
+      if (flags & CLOCK_PRO_TEST) {
+        // Accessed again during its test period
+        s->flags[page_num] &= ~CLOCK_PRO_TEST;
+        s->num_cold--;
+        clock_pro_make_hot(s, page_num);
+      } else {
+        s->flags[page_num] |= CLOCK_PRO_TEST;
+        clock_pro_remove(s, page_num);
+        clock_pro_insert(s, page_num);
+      }
+      continue;
+    }
+
+    s->flags[page_num] &= ~CLOCK_PRO_RESIDENT;
+    s->num_cold--;
+    if (flags & CLOCK_PRO_TEST) {
+      // Stays in the list in case it's faulted on while in its test period
+      s->num_nonresident++;
+      while (s->num_nonresident > s->c) {
+        clock_pro_run_hand_test(s);
+      }
+    } else {
+      clock_pro_remove(s, page_num);
+    }
+    return frame_of(page_num);
+  }
+}
+
+void clock_pro_on_fault(void *state, struct page_table_entry *pte) {
+  struct clock_pro_state *s = state;
+  int page_num = pte->page_num;
+
+  if (s->flags[page_num] & CLOCK_PRO_IN_LIST) {
+    // Evicted during its test period, so cold pages need more frames
+    s->cold_target = min(s->cold_target + 1, s->c);
+    clock_pro_remove(s, page_num);
+    s->num_nonresident--;
+    s->flags[page_num] = CLOCK_PRO_RESIDENT;
+    clock_pro_insert(s, page_num);
+    clock_pro_make_hot(s, page_num);
+    return;
+  }
+
+  s->flags[page_num] = CLOCK_PRO_RESIDENT;
+  clock_pro_insert(s, page_num);
+  if (!s->filled && s->num_hot < s->c - s->cold_target) {
+    // Pages are hot until the frames for hot pages are filled
+    s->flags[page_num] |= CLOCK_PRO_HOT;
+    s->num_hot++;
+  } else {
+    s->flags[page_num] |= CLOCK_PRO_TEST;
+    s->num_cold++;
+  }
+}
+
+void clock_pro_cleanup(void *state) {
+  struct clock_pro_state *s = state;
+  free(s->prev);
+  free(s->next);
+  free(s->flags);
+  free(s);
+}
+
+void clock_pro_snapshot(void *state, struct snapshot *snap) {
+  struct clock_pro_state *s = state;
+  SNAPSHOT_FIELD(snap, s->cold_target);
+  SNAPSHOT_FIELD(snap, s->num_hot);
+  SNAPSHOT_FIELD(snap, s->num_cold);
+  SNAPSHOT_FIELD(snap, s->num_nonresident);
+  SNAPSHOT_FIELD(snap, s->filled);
+  snapshot_page_list(snap, &s->list);
+  snapshot_data(snap, s->prev, num_pages * sizeof(int));
+  snapshot_data(snap, s->next, num_pages * sizeof(int));
+  SNAPSHOT_FIELD(snap, s->hand_hot);
+  SNAPSHOT_FIELD(snap, s->hand_cold);
+  SNAPSHOT_FIELD(snap, s->hand_test);
+  snapshot_data(snap, s->flags, num_pages);
+}
+
+const struct policy policies[] = {
+    {"OPT", opt_init, opt_on_access, opt_on_access, opt_evict, opt_cleanup,
+     opt_on_future_access, opt_snapshot},
+    {"FIFO", fifo_init, NULL, NULL, fifo_evict, free, NULL, fifo_snapshot},
+    {"CLOCK", clock_init, clock_on_access, clock_on_access, clock_evict,
+     clock_cleanup, NULL, clock_snapshot},
+    {"LRU", lru_init, lru_on_access, lru_on_access, lru_evict, lru_cleanup,
+     NULL, lru_snapshot},
+    // RANDOM has nothing to snapshot: num_frames comes from init, and the
+    // state of rand() is brought back by snapshot_simulation
+    {"RANDOM", random_init, NULL, NULL, random_evict, free, NULL, NULL},
+    {"ARC", arc_init, arc_on_access, arc_on_fault, arc_evict, arc_cleanup, NULL,
+     arc_snapshot},
+    {"2Q", two_q_init, two_q_on_access, two_q_on_fault, two_q_evict,
+     two_q_cleanup, NULL, two_q_snapshot},
+    {"LIRS", lirs_init, lirs_on_access, lirs_on_fault, lirs_evict,
+     lirs_cleanup, NULL, lirs_snapshot},
+    {"CLOCK-PRO", clock_pro_init, clock_pro_on_access, clock_pro_on_fault,
+     clock_pro_evict, clock_pro_cleanup, NULL, clock_pro_snapshot},
+};
+
+const struct policy *find_policy(const char *name) {
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    if (strcmp(policies[i].name, name) == 0) {
+      return &policies[i];
+    }
+  }
+  return NULL;
+}
+
+// Pages not in memory are accounted for once they're brought in by
+// get_page_from_disk
+void count_access(struct page_table_entry *pte) {
+  if (pte->valid && cmdline_args.policy->on_access) {
+    cmdline_args.policy->on_access(policy_state, pte);
+  }
+}
+
+// Evictions are logged through a large buffer which is written out only when
+// it fills up, and the text is formatted by hand. With printf on every eviction
+// formatting used to dominate the runtime of verbose runs.
+#define EVENT_LOG_BUF_SIZE (1 << 20)
+
+struct event_log {
+  FILE *file;
+  size_t len;
+  char buf[EVENT_LOG_BUF_SIZE];
+};
+
+struct event_log verbose_log, binary_log;
+
+// Binary event logs start with this, followed by a record of
+// EVENT_RECORD_SIZE bytes per eviction: the page read and then the page
+// written or dropped shifted left by one with the lowest bit set if it was
+// written. Both are 32 bit little endian.
+const char EVENT_LOG_MAGIC[8] = "FRMEVT01";
+#define EVENT_RECORD_SIZE 8
+
+void event_log_flush(struct event_log *log) {
+  if (log->len && fwrite(log->buf, 1, log->len, log->file) != log->len) {
+    perror("Writing event log");
+    exit(1);
+  }
+  log->len = 0;
+}
+
+// Returns where the next size bytes of the log should be written
+char *event_log_reserve(struct event_log *log, size_t size) {
+  if (log->len + size > EVENT_LOG_BUF_SIZE) {
+    event_log_flush(log);
+  }
+  return log->buf + log->len;
+}
+
+void event_log_append(struct event_log *log, const char *str, size_t len) {
+  memcpy(event_log_reserve(log, len), str, len);
+  log->len += len;
+}
+
+// Same as "%05x". Returns the end of what was written.
+char *format_hex(char *out, unsigned value) {
+  static const char digits[] = "0123456789abcdef";
+  int num_digits = 5;
+  while (num_digits < 8 && (value >> (4 * num_digits))) {
+    num_digits++;
+  }
+  for (int i = num_digits - 1; i >= 0; i--) {
+    out[i] = digits[value & 0xf];
+    value >>= 4;
+  }
+  return out + num_digits;
+}
+
+void put_u32_le(char *out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out[i] = (value >> (8 * i)) & 0xff;
+  }
+}
+
+void init_event_logs() {
+  verbose_log.file = stdout;
+  if (cmdline_args.event_log_file) {
+    binary_log.file = cmdline_args.event_log_file;
+    event_log_append(&binary_log, EVENT_LOG_MAGIC, sizeof(EVENT_LOG_MAGIC));
+  }
+}
+
+void flush_event_logs() {
+  if (cmdline_args.verbose) {
+    event_log_flush(&verbose_log);
+  }
+  if (cmdline_args.event_log_file) {
+    event_log_flush(&binary_log);
+  }
+}
+
+#define STR_LEN(str) (sizeof(str) - 1)
+
+void print_verbose(int written_page, int read_page, bool dirty) {
+  if (cmdline_args.event_log_file) {
+    char *out = event_log_reserve(&binary_log, EVENT_RECORD_SIZE);
+    put_u32_le(out, read_page);
+    put_u32_le(out + 4, ((uint32_t)written_page << 1) | dirty);
+    binary_log.len += EVENT_RECORD_SIZE;
+  }
+
+  if (!cmdline_args.verbose)
+    return;
+  static const char read_str[] = "Page 0x";
+  static const char mid_str[] = " was read from disk, page 0x";
+  static const char written_str[] = " was written to the disk.\n";
+  static const char dropped_str[] = " was dropped (it was not dirty).\n";
+  // Long enough for any line, with 8 digits for each page
+  char line[STR_LEN(read_str) + STR_LEN(mid_str) + STR_LEN(dropped_str) + 16];
+
+  char *out = line;
+  memcpy(out, read_str, STR_LEN(read_str));
+  out = format_hex(out + STR_LEN(read_str), read_page);
+  memcpy(out, mid_str, STR_LEN(mid_str));
+  out = format_hex(out + STR_LEN(mid_str), written_page);
+  if (dirty) {
+    memcpy(out, written_str, STR_LEN(written_str));
+    out += STR_LEN(written_str);
+  } else {
+    memcpy(out, dropped_str, STR_LEN(dropped_str));
+    out += STR_LEN(dropped_str);
+  }
+  event_log_append(&verbose_log, line, out - line);
+}
+
+// For the mixed mode, state of each 2MB region of the address space. Once
+// enough of its base pages have been faulted in, a region is promoted to a huge
+// page: the rest of its base pages are brought in too, and it's mapped by a
+// single huge page, which becomes dirty as a whole on any write. Evicting any
+// of its pages splits it back into base pages first, as the kernel does with
+// transparent huge pages under memory pressure.
+struct region {
+  bool huge;
+  bool dirty;       // Written to since it became huge
+  int num_faulted;  // Base pages faulted in since it was last split
+} *regions;
+
+struct {
+  int num_promotions;
+  int num_splits;
+  long promoted_pages; // Base pages brought in by promotions
+} huge_stats;
+
+// Whether the page is mapped by a huge page
+bool in_huge_page(int page_num) {
+  if (cmdline_args.mixed_pages) {
+    return regions[page_num >> HUGE_PAGE_BITS].huge;
+  }
+  return page_size_bits > BASE_PAGE_SIZE_BITS;
+}
+
+// TLBs in front of the page table. A translation is looked up level by level,
+// and if no level has it the page table is walked, after which every level
+// which missed is filled. Translations of huge pages go in a level's huge page
+// entries if it has them, tagged by the huge page number, and in its regular
+// entries otherwise. Entries are dropped when their page is evicted.
+struct tlb_array {
+  int sets, ways;
+  int *tags;       // sets * ways of them, -1 for an invalid entry
+  long *last_used; // For LRU
+};
+
+struct tlb_level {
+  struct tlb_array base, huge;
+  bool random;
+  long lookups, hits;
+} tlbs[MAX_TLB_LEVELS];
+
+long tlb_clock;  // Incremented on every lookup, for LRU
+long page_walks; // Lookups which missed in every level
+// State of xorshift for random replacement, separate from rand() so that the
+// TLBs don't change what RANDOM evicts
+uint32_t tlb_random_state = 5635;
+
+void tlb_array_init(struct tlb_array *arr, int sets, int ways) {
+  arr->sets = sets;
+  arr->ways = ways;
+  if (!sets) {
+    return;
+  }
+  arr->tags = alloc_or_die((long)sets * ways * sizeof(int));
+  arr->last_used = alloc_or_die((long)sets * ways * sizeof(long));
+  for (long i = 0; i < (long)sets * ways; i++) {
+    arr->tags[i] = -1;
+  }
+}
+
+// Index of the entry for tag, or -1 if it isn't there
+long tlb_array_find(struct tlb_array *arr, int tag) {
+  long set_start = (long)(tag % arr->sets) * arr->ways;
+  for (long i = set_start; i < set_start + arr->ways; i++) {
+    if (arr->tags[i] == tag) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void tlb_array_fill(struct tlb_array *arr, int tag, bool random) {
+  long set_start = (long)(tag % arr->sets) * arr->ways;
+  long victim = set_start;
+  for (long i = set_start; i < set_start + arr->ways; i++) {
+    if (arr->tags[i] == -1) {
+      victim = i;
+      break;
+    }
+    if (arr->last_used[i] < arr->last_used[victim]) {
+      victim = i;
+    }
+  }
+  if (random && arr->tags[victim] != -1) {
+    tlb_random_state ^= tlb_random_state << 13;
+    tlb_random_state ^= tlb_random_state >> 17;
+    tlb_random_state ^= tlb_random_state << 5;
+    victim = set_start + tlb_random_state % arr->ways;
+  }
+  arr->tags[victim] = tag;
+  arr->last_used[victim] = tlb_clock;
+}
+
+// The array of level which holds the translation for page_num, and its tag
+struct tlb_array *tlb_array_for(struct tlb_level *level, int page_num,
+                                int *tag) {
+  if (level->huge.sets && in_huge_page(page_num)) {
+    *tag = cmdline_args.mixed_pages ? page_num >> HUGE_PAGE_BITS : page_num;
+    return &level->huge;
+  }
+  *tag = page_num;
+  return &level->base;
+}
+
+void init_tlbs() {
+  for (int i = 0; i < cmdline_args.num_tlb_levels; i++) {
+    struct tlb_config *config = &cmdline_args.tlb_levels[i];
+    tlb_array_init(&tlbs[i].base, config->sets, config->ways);
+    tlb_array_init(&tlbs[i].huge, config->huge_sets, config->huge_ways);
+    tlbs[i].random = config->random;
+  }
+}
+
+// Translates num_accesses consecutive accesses to page_num. Only the first
+// can miss, the rest hit in L1.
+void tlb_translate(int page_num, long num_accesses) {
+  tlb_clock++;
+  tlbs[0].lookups += num_accesses - 1;
+  tlbs[0].hits += num_accesses - 1;
+
+  int level = 0;
+  for (; level < cmdline_args.num_tlb_levels; level++) {
+    int tag;
+    struct tlb_array *arr = tlb_array_for(&tlbs[level], page_num, &tag);
+    tlbs[level].lookups++;
+    long entry = tlb_array_find(arr, tag);
+    if (entry != -1) {
+      tlbs[level].hits++;
+      arr->last_used[entry] = tlb_clock;
+      break;
+    }
+  }
+  if (level == cmdline_args.num_tlb_levels) {
+    page_walks++;
+  }
+
+  for (int i = 0; i < level; i++) {
+    int tag;
+    struct tlb_array *arr = tlb_array_for(&tlbs[i], page_num, &tag);
+    tlb_array_fill(arr, tag, tlbs[i].random);
+  }
+}
+
+void tlb_invalidate(int page_num) {
+  for (int i = 0; i < cmdline_args.num_tlb_levels; i++) {
+    int tag;
+    struct tlb_array *arr = tlb_array_for(&tlbs[i], page_num, &tag);
+    long entry = tlb_array_find(arr, tag);
+    if (entry != -1) {
+      arr->tags[entry] = -1;
+    }
+  }
+}
+
+void print_page_size_stats() {
+  long page_size = 1L << page_size_bits;
+  printf("Page size: %s\n", cmdline_args.mixed_pages ? "mixed 4K/2M"
+                            : page_size_bits == 12  ? "4K"
+                            : page_size_bits == 21  ? "2M"
+                                                    : "1G");
+  printf("Bytes written to the disk: %ld\n", stats.num_writes * page_size);
+  int resident = 0, untouched = 0;
+  for (int i = 0; i < num_pages; i++) {
+    resident += page_table[i].valid;
+    untouched += page_table[i].valid && !page_table[i].accessed;
+  }
+  printf("Resident memory: %ld bytes\n", resident * page_size);
+  if (cmdline_args.mixed_pages) {
+    int huge_regions = 0;
+    for (int i = 0; i < num_pages >> HUGE_PAGE_BITS; i++) {
+      huge_regions += regions[i].huge;
+    }
+    printf("Resident memory never accessed: %ld bytes\n",
+           untouched * page_size);
+    printf("Huge pages resident: %d\n", huge_regions);
+    printf("Number of promotions: %d\n", huge_stats.num_promotions);
+    printf("Number of splits: %d\n", huge_stats.num_splits);
+    printf("Pages read from disk by promotions: %ld\n",
+           huge_stats.promoted_pages);
+  }
+}
+
+void print_latency_stats() {
+  printf("Estimated stall time: %.6f s\n", stats.stall_time / 1e6);
+  printf("Of which waiting for dirty pages: %.6f s\n",
+         stats.write_stall_time / 1e6);
+  if (cmdline_args.flush_interval) {
+    printf("Number of background writes: %d\n", stats.num_flushes);
+  }
+}
+
+void print_prefetch_stats() {
+  printf("Number of prefetches: %d\n", stats.num_prefetches);
+  printf("Useful prefetches: %d\n", stats.num_useful_prefetches);
+  printf("Wasted prefetches: %d\n", stats.num_wasted_prefetches);
+  printf("Prefetched pages not accessed yet: %d\n",
+         stats.num_prefetches - stats.num_useful_prefetches -
+             stats.num_wasted_prefetches);
+}
+
+void print_tlb_stats() {
+  for (int i = 0; i < cmdline_args.num_tlb_levels; i++) {
+    printf("TLB L%d lookups: %ld, hits: %ld, hit rate: %.6f\n", i + 1,
+           tlbs[i].lookups, tlbs[i].hits,
+           tlbs[i].lookups ? (double)tlbs[i].hits / tlbs[i].lookups : 0);
+  }
+  printf("Number of page walks: %ld\n", page_walks);
+}
+
+void cleanup_tlbs() {
+  for (int i = 0; i < cmdline_args.num_tlb_levels; i++) {
+    free(tlbs[i].base.tags);
+    free(tlbs[i].base.last_used);
+    free(tlbs[i].huge.tags);
+    free(tlbs[i].huge.last_used);
+  }
+}
+
+// Pages are queued for the background flusher in the order they got dirty
+struct {
+  long next_run; // Number of accesses done when the flusher runs next
+  int *prev, *next;
+  struct page_list dirty;
+} flusher;
+
+void mark_dirty(struct page_table_entry *pte) {
+  pte->dirty = true;
+  stats.num_dirty++;
+  if (cmdline_args.flush_interval) {
+    page_list_push_back(&flusher.dirty, pte->page_num);
+  }
+}
+
+void mark_clean(struct page_table_entry *pte) {
+  pte->dirty = false;
+  stats.num_dirty--;
+  if (cmdline_args.flush_interval) {
+    page_list_remove(&flusher.dirty, pte->page_num);
+  }
+}
+
+void init_flusher() {
+  flusher.next_run = cmdline_args.flush_interval;
+  flusher.prev = alloc_page_array(-1);
+  flusher.next = alloc_page_array(-1);
+  page_list_init(&flusher.dirty, flusher.prev, flusher.next);
+}
+
+// The writes are assumed to be done by the time the pages are evicted, and
+// not to slow down reads from the disk
+void run_flusher(long accesses_done) {
+  for (int i = 0; i < cmdline_args.flush_pages && flusher.dirty.size; i++) {
+    mark_clean(&page_table[flusher.dirty.head]);
+    stats.num_flushes++;
+  }
+  while (flusher.next_run <= accesses_done) {
+    flusher.next_run += cmdline_args.flush_interval;
+  }
+}
+
+void tlb_invalidate(int page_num);
+bool evict_page(struct page_table_entry *pte);
+bool bring_in_page(struct page_table_entry *pte);
+bool page_sampled(int page_num);
+
+// Maps the region by a huge page, bringing in the rest of its pages. Stops
+// early if bringing them in evicts one of its own pages, which splits it.
+void promote_region(int region_num) {
+  struct region *region = &regions[region_num];
+  region->huge = true;
+  huge_stats.num_promotions++;
+  int first_page = region_num << HUGE_PAGE_BITS;
+  for (int i = 0; i < (1 << HUGE_PAGE_BITS) && region->huge; i++) {
+    struct page_table_entry *pte = &page_table[first_page + i];
+    if (pte->valid) {
+      // Its base page translation is replaced by the huge page
+      if (cmdline_args.num_tlb_levels) {
+        region->huge = false;
+        tlb_invalidate(first_page + i);
+        region->huge = true;
+      }
+      continue;
+    }
+    pte->page_num = first_page + i;
+    pte->accessed = false;
+    bring_in_page(pte);
+    huge_stats.promoted_pages++;
+  }
+}
+
+void split_region(int region_num) {
+  struct region *region = &regions[region_num];
+  if (cmdline_args.num_tlb_levels) {
+    tlb_invalidate(region_num << HUGE_PAGE_BITS);
+  }
+  region->huge = false;
+  region->num_faulted = 0;
+  huge_stats.num_splits++;
+  if (!region->dirty) {
+    return;
+  }
+
+  // The kernel only knows the huge page was dirty, so all its base pages are
+  // marked dirty
+  region->dirty = false;
+  int first_page = region_num << HUGE_PAGE_BITS;
+  for (int i = 0; i < (1 << HUGE_PAGE_BITS); i++) {
+    struct page_table_entry *pte = &page_table[first_page + i];
+    if (pte->valid && !pte->dirty) {
+      mark_dirty(pte);
+    }
+  }
+}
+
+// Takes the page out of memory, returning whether it had to be written to the
+// disk
+bool evict_page(struct page_table_entry *pte) {
+  if (cmdline_args.mixed_pages &&
+      regions[pte->page_num >> HUGE_PAGE_BITS].huge) {
+    split_region(pte->page_num >> HUGE_PAGE_BITS);
+  }
+  pte->valid = false;
+  if (pte->prefetched) {
+    pte->prefetched = false;
+    stats.num_wasted_prefetches++;
+  }
+  if (cmdline_args.num_tlb_levels) {
+    tlb_invalidate(pte->page_num);
+  }
+  if (!pte->dirty) {
+    stats.num_drops++;
+    return false;
+  }
+  stats.num_writes++;
+  mark_clean(pte);
+  return true;
+}
+
+// Brings pte's page into a free frame, evicting a page if there's none.
+// Returns whether the evicted page had to be written to the disk first.
+bool bring_in_page(struct page_table_entry *pte) {
+  bool written = false;
+  if (next_free_frame < num_frames) {
+    pte->frame_num = next_free_frame++;
+  } else {
+    // Need to evict
+    int frame_num = cmdline_args.policy->evict(policy_state, pte);
+    struct page_table_entry *pte_evict = frame_list[frame_num];
+    assert(pte_evict->valid &&
+           "Page to evict must be in memory in the first place");
+    written = evict_page(pte_evict);
+    pte->frame_num = pte_evict->frame_num;
+    print_verbose(pte_evict->page_num, pte->page_num, written);
+  }
+
+  frame_list[pte->frame_num] = pte;
+  pte->dirty = false;
+  pte->valid = true;
+  if (cmdline_args.policy->on_fault) {
+    cmdline_args.policy->on_fault(policy_state, pte);
+  }
+  return written;
+}
+
+void get_page_from_disk(struct page_table_entry *pte) {
+  stats.num_misses++;
+  if (page_misses) {
+    page_misses[pte->page_num]++;
+  }
+
+  // The access waits for the page to be read, and for the page evicted for it
+  // to be written first if it was dirty. Pages brought in by promotions and
+  // prefetches are read in the background.
+  stats.stall_time += cmdline_args.read_latency;
+  if (bring_in_page(pte)) {
+    stats.stall_time += cmdline_args.write_latency;
+    stats.write_stall_time += cmdline_args.write_latency;
+  }
+
+  // A huge page has to fit in memory with room to spare
+  if (cmdline_args.mixed_pages &&
+      num_frames > (1 << HUGE_PAGE_BITS)) {
+    int region_num = pte->page_num >> HUGE_PAGE_BITS;
+    struct region *region = &regions[region_num];
+    region->num_faulted++;
+    if (!region->huge &&
+        region->num_faulted >= cmdline_args.promote_threshold) {
+      promote_region(region_num);
+    }
+  }
+}
+
+/* ------------------------------ Prefetching ------------------------------ */
+
+// A prefetcher is told about every demand fault, once the access which caused
+// it is done, and about every first access to a page it brought in, and may
+// bring in more pages with prefetch_page. Its state is kept like a policy's.
+struct prefetcher {
+  const char *name;
+  void *(*init)();
+  void (*on_fault)(void *state, int page_num);
+  // Page brought in by the prefetcher was accessed. May be NULL.
+  void (*on_prefetch_hit)(void *state, int page_num);
+  void (*cleanup)(void *state);
+  void (*snapshot)(void *state, struct snapshot *snap); // As for policies
+};
+
+void *prefetcher_state;
+
+// Brings in page_num unless it's already in memory, without counting a miss
+void prefetch_page(int page_num) {
+  // Only pages of the same process
+  if (page_num < 0 || page_num >> vpn_bits != curr_page >> vpn_bits ||
+      page_table[page_num].valid) {
+    return;
+  }
+  // Sampled traces don't know about the other pages
+  if (cmdline_args.sample_rate < 1 && !page_sampled(page_num)) {
+    return;
+  }
+  struct page_table_entry *pte = &page_table[page_num];
+  pte->page_num = page_num;
+  pte->accessed = false;
+  pte->prefetched = true;
+  bring_in_page(pte);
+  stats.num_prefetches++;
+}
+
+// Sequential readahead as in Linux: a fault right after the previous one, or
+// right after the pages read ahead for it, reads ahead a window of pages, and
+// the first access to the first page of that window reads ahead the next one
+// before it's needed. The window doubles while the accesses stay sequential,
+// up to READAHEAD_MAX_WINDOW, and is back to READAHEAD_INIT_WINDOW when not.
+#define READAHEAD_INIT_WINDOW 4
+#define READAHEAD_MAX_WINDOW 64
+
+struct readahead_state {
+  int last_fault;
+  int window;
+  int start, end; // Pages last read ahead are [start, end)
+};
+
+void *readahead_init() {
+  struct readahead_state *s = alloc_or_die(sizeof(*s));
+  s->last_fault = -2;
+  s->window = READAHEAD_INIT_WINDOW;
+  s->start = s->end = -1;
+  return s;
+}
+
+void readahead(struct readahead_state *s, int from) {
+  s->start = from;
+  s->end = min(from + s->window, num_pages);
+  for (int page_num = s->start; page_num < s->end; page_num++) {
+    prefetch_page(page_num);
+  }
+}
+
+void readahead_on_fault(void *state, int page_num) {
+  struct readahead_state *s = state;
+  bool sequential = page_num == s->last_fault + 1 || page_num == s->end;
+  s->last_fault = page_num;
+  if (!sequential) {
+    s->window = READAHEAD_INIT_WINDOW;
+    return;
+  }
+  s->window = min(s->window * 2, READAHEAD_MAX_WINDOW);
+  readahead(s, page_num + 1);
+}
+
+void readahead_snapshot(void *state, struct snapshot *snap) {
+  snapshot_data(snap, state, sizeof(struct readahead_state));
+}
+
+void readahead_on_prefetch_hit(void *state, int page_num) {
+  struct readahead_state *s = state;
+  if (page_num != s->start) {
+    return;
+  }
+  s->window = min(s->window * 2, READAHEAD_MAX_WINDOW);
+  readahead(s, s->end);
+}
+
+// Once two consecutive faults are the same distance apart, the next
+// STRIDE_DEGREE pages that far apart are brought in.
+#define STRIDE_DEGREE 4
+
+struct stride_state {
+  int last_fault;
+  int stride;
+};
+
+void *stride_init() {
+  struct stride_state *s = alloc_or_die(sizeof(*s));
+  s->last_fault = -1;
+  return s;
+}
+
+void stride_snapshot(void *state, struct snapshot *snap) {
+  snapshot_data(snap, state, sizeof(struct stride_state));
+}
+
+void stride_on_fault(void *state, int page_num) {
+  struct stride_state *s = state;
+  int stride = page_num - s->last_fault;
+  bool confirmed = s->last_fault != -1 && stride == s->stride;
+  s->last_fault = page_num;
+  s->stride = stride;
+  if (!confirmed || stride == 0) {
+    return;
+  }
+  for (int i = 1; i <= STRIDE_DEGREE; i++) {
+    long next = page_num + (long)stride * i;
+    if (next < 0 || next >= num_pages) {
+      break;
+    }
+    prefetch_page(next);
+  }
+}
+
+// Remembers which page faulted right after each one, and on a fault brings in
+// the page which followed it last time, and the one which followed that, up to
+// MARKOV_DEPTH pages.
+#define MARKOV_DEPTH 2
+
+struct markov_state {
+  int last_fault;
+  int *next_fault;
+};
+
+void *markov_init() {
+  struct markov_state *s = alloc_or_die(sizeof(*s));
+  s->last_fault = -1;
+  s->next_fault = alloc_page_array(-1);
+  return s;
+}
+
+void markov_on_fault(void *state, int page_num) {
+  struct markov_state *s = state;
+  if (s->last_fault != -1) {
+    s->next_fault[s->last_fault] = page_num;
+  }
+  s->last_fault = page_num;
+  int next = s->next_fault[page_num];
+  for (int i = 0; i < MARKOV_DEPTH && next != -1 && next != page_num; i++) {
+    prefetch_page(next);
+    next = s->next_fault[next];
+  }
+}
+
+void markov_cleanup(void *state) {
+  struct markov_state *s = state;
+  free(s->next_fault);
+  free(s);
+}
+
+void markov_snapshot(void *state, struct snapshot *snap) {
+  struct markov_state *s = state;
+  SNAPSHOT_FIELD(snap, s->last_fault);
+  snapshot_data(snap, s->next_fault, num_pages * sizeof(int));
+}
+
+const struct prefetcher prefetchers[] = {
+    {"readahead", readahead_init, readahead_on_fault,
+     readahead_on_prefetch_hit, free, readahead_snapshot},
+    {"stride", stride_init, stride_on_fault, NULL, free, stride_snapshot},
+    {"markov", markov_init, markov_on_fault, NULL, markov_cleanup,
+     markov_snapshot},
+};
+
+const struct prefetcher *find_prefetcher(const char *name) {
+  for (size_t i = 0; i < sizeof(prefetchers) / sizeof(prefetchers[0]); i++) {
+    if (strcmp(prefetchers[i].name, name) == 0) {
+      return &prefetchers[i];
+    }
+  }
+  return NULL;
+}
+
+/* ------------------------------- Processes ------------------------------- */
+
+// With several processes, each has its own part of the page table, and unless
+// the frames are shared globally, its own share of them replaced by its own
+// instance of the policy. Running a process switches to its frames.
+struct process {
+  long num_accesses;
+  long num_misses;
+  int num_frames;
+  int next_free_frame;
+  struct page_table_entry **frame_list;
+  void *policy_state;
+  int ws_size; // Pages accessed since the last rebalancing
+} procs[MAX_PROCS];
+
+int curr_proc;
+
+struct {
+  long next_run; // Number of accesses done when the frames are next rebalanced
+  int epoch;     // Number of rebalancings so far
+  int *last_epoch; // Epoch each page was last accessed in
+} rebalance;
+
+void switch_to_process(int proc) {
+  if (cmdline_args.partition == GLOBAL || proc == curr_proc) {
+    return;
+  }
+  procs[curr_proc].next_free_frame = next_free_frame;
+  curr_proc = proc;
+  next_free_frame = procs[proc].next_free_frame;
+  num_frames = procs[proc].num_frames;
+  frame_list = procs[proc].frame_list;
+  policy_state = procs[proc].policy_state;
+}
+
+// Policy state which page_num is replaced by
+void *policy_state_of(int page_num) {
+  if (cmdline_args.partition == GLOBAL) {
+    return policy_state;
+  }
+  return procs[page_num >> vpn_bits].policy_state;
+}
+
+void init_policy() {
+  if (cmdline_args.partition == GLOBAL) {
+    policy_state = cmdline_args.policy->init(num_frames);
+    return;
+  }
+
+  int n = cmdline_args.num_procs;
+  for (int i = 0; i < n; i++) {
+    struct process *proc = &procs[i];
+    proc->num_frames = num_frames / n + (i < num_frames % n);
+    // Room for all the frames, which it may get by rebalancing
+    proc->frame_list =
+        alloc_or_die(num_frames * sizeof(struct page_table_entry *));
+    proc->policy_state = cmdline_args.policy->init(proc->num_frames);
+  }
+  if (cmdline_args.partition == WORKING_SET) {
+    rebalance.next_run = cmdline_args.rebalance_interval;
+    rebalance.last_epoch = alloc_page_array(-1);
+  }
+  curr_proc = 0;
+  next_free_frame = 0;
+  num_frames = procs[0].num_frames;
+  frame_list = procs[0].frame_list;
+  policy_state = procs[0].policy_state;
+}
+
+void cleanup_policy() {
+  if (cmdline_args.partition == GLOBAL) {
+    cmdline_args.policy->cleanup(policy_state);
+    return;
+  }
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    cmdline_args.policy->cleanup(procs[i].policy_state);
+    free(procs[i].frame_list);
+  }
+  free(rebalance.last_epoch);
+  frame_list = NULL;
+}
+
+int compare_last_access(const void *a, const void *b) {
+  long access_a = (*(struct page_table_entry **)a)->last_access;
+  long access_b = (*(struct page_table_entry **)b)->last_access;
+  return (access_a > access_b) - (access_a < access_b);
+}
+
+// Gives the process new_frames frames. Its policy starts over with the pages it
+// keeps, which are the ones it accessed last, brought in again from the least
+// recently accessed one.
+void resize_process(int proc, int new_frames) {
+  switch_to_process(proc);
+  int resident = min(next_free_frame, num_frames);
+  qsort(frame_list, resident, sizeof(frame_list[0]), compare_last_access);
+  int num_evicted = max(resident - new_frames, 0);
+  for (int i = 0; i < num_evicted; i++) {
+    evict_page(frame_list[i]);
+  }
+
+  cmdline_args.policy->cleanup(policy_state);
+  policy_state = cmdline_args.policy->init(new_frames);
+  num_frames = new_frames;
+  next_free_frame = resident - num_evicted;
+  for (int i = 0; i < next_free_frame; i++) {
+    struct page_table_entry *pte = frame_list[num_evicted + i];
+    frame_list[i] = pte;
+    pte->frame_num = i;
+    if (cmdline_args.policy->on_fault) {
+      cmdline_args.policy->on_fault(policy_state, pte);
+    }
+  }
+  procs[proc].num_frames = num_frames;
+  procs[proc].policy_state = policy_state;
+}
+
+// Every process gets a frame, and the rest in proportion to the number of
+// pages it accessed since the last rebalancing, its working set
+void rebalance_frames(long accesses_done) {
+  int n = cmdline_args.num_procs;
+  long total_ws = 0;
+  for (int i = 0; i < n; i++) {
+    total_ws += procs[i].ws_size;
+  }
+  if (total_ws) {
+    int spare = cmdline_args.num_frames - n;
+    int new_frames[MAX_PROCS], given = 0;
+    for (int i = 0; i < n; i++) {
+      new_frames[i] = 1 + spare * procs[i].ws_size / total_ws;
+      given += new_frames[i];
+    }
+    for (int i = 0; given < cmdline_args.num_frames; i = (i + 1) % n) {
+      new_frames[i]++;
+      given++;
+    }
+    // Frames have to be taken away before they're given to others
+    for (int shrink = 1; shrink >= 0; shrink--) {
+      for (int i = 0; i < n; i++) {
+        if ((new_frames[i] < procs[i].num_frames) == shrink &&
+            new_frames[i] != procs[i].num_frames) {
+          resize_process(i, new_frames[i]);
+        }
+      }
+    }
+  }
+
+  for (int i = 0; i < n; i++) {
+    procs[i].ws_size = 0;
+  }
+  rebalance.epoch++;
+  while (rebalance.next_run <= accesses_done) {
+    rebalance.next_run += cmdline_args.rebalance_interval;
+  }
+}
+
+void print_process_stats() {
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    int resident = 0;
+    for (int page_num = i << vpn_bits; page_num < (i + 1) << vpn_bits;
+         page_num++) {
+      resident += page_table[page_num].valid;
+    }
+    printf("Process %d (%s): %ld memory accesses, %ld misses, %d frames in "
+           "use\n",
+           i, cmdline_args.trace_names[i], procs[i].num_accesses,
+           procs[i].num_misses, resident);
+  }
+}
+
+void perform_read(struct page_table_entry *pte) {
+  if (pte->valid) {
+    return;
+  }
+
+  // Translation not valid, need to bring page from disk.
+  get_page_from_disk(pte);
+  perform_read(pte);
+}
+
+void perform_write(struct page_table_entry *pte) {
+  if (pte->valid) {
+    if (cmdline_args.mixed_pages) {
+      struct region *region = &regions[pte->page_num >> HUGE_PAGE_BITS];
+      region->dirty = region->dirty || region->huge;
+    }
+    if (!pte->dirty) {
+      mark_dirty(pte);
+    }
+    return;
+  }
+
+  // Translation not valid, need to bring page from disk.
+  get_page_from_disk(pte);
+  perform_write(pte);
+}
+
+void perform_op(struct condensed_memory_op op) {
+  assert(op.page_num < num_pages && op.page_num >= 0 &&
+         "Virtual Page Number must fit into the bits reserved for it");
+
+  if (cmdline_args.num_tlb_levels) {
+    tlb_translate(op.page_num, op.num_accesses);
+  }
+
+  curr_page = op.page_num;
+  struct page_table_entry *pte = &page_table[op.page_num];
+  count_access(pte);
+  pte->page_num = op.page_num;
+  pte->accessed = true;
+  pte->last_access = accesses_done;
+  bool faulted = !pte->valid;
+  bool prefetch_hit = pte->valid && pte->prefetched;
+  if (op.read) {
+    perform_read(pte);
+  }
+  if (op.write) {
+    perform_write(pte);
+  }
+
+  const struct prefetcher *prefetcher = cmdline_args.prefetcher;
+  if (prefetch_hit) {
+    pte->prefetched = false;
+    stats.num_useful_prefetches++;
+    if (prefetcher->on_prefetch_hit) {
+      prefetcher->on_prefetch_hit(prefetcher_state, op.page_num);
+    }
+  } else if (faulted && prefetcher) {
+    prefetcher->on_fault(prefetcher_state, op.page_num);
+  }
+}
+
+// Sampling as in SHARDS (Waldspurger et al.): a page is kept iff a hash of its
+// number falls below rate * 2^32. Since whole pages are kept or dropped, the
+// reuse behaviour of the kept ones is undisturbed, and with proportionally
+// fewer frames they see about the same miss ratio as the full trace.
+uint32_t hash_page(uint32_t page_num) {
+  // Finalizer of MurmurHash3
+  page_num ^= page_num >> 16;
+  page_num *= 0x85ebca6b;
+  page_num ^= page_num >> 13;
+  page_num *= 0xc2b2ae35;
+  page_num ^= page_num >> 16;
+  return page_num;
+}
+
+bool page_sampled(int page_num) {
+  return hash_page(page_num) <= cmdline_args.sample_rate * 4294967295.0;
+}
+
+// Grows *array to hold one more element than *capacity if it's full
+void grow_array(void **array, long *capacity, long size, size_t elem_size) {
+  if (size < *capacity) {
+    return;
+  }
+  *capacity *= 2;
+  *array = realloc(*array, *capacity * elem_size);
+  if (!*array) {
+    perror("Inputting trace file");
+    exit(1);
+  }
+}
+
+const int INIT_SIZE = 20;
+long long_runs_capacity;
+
+void add_condensed_access(struct condensed_memory_op op, long *capacity) {
+  grow_array((void **)&condensed_mem_accesses, capacity,
+             num_condensed_accesses, sizeof(*condensed_mem_accesses));
+  long index = num_condensed_accesses++;
+  condensed_mem_accesses[index] = (struct packed_memory_op){
+      .page_num = op.page_num,
+      .read = op.read,
+      .write = op.write,
+      .num_accesses = op.num_accesses < LONG_RUN ? op.num_accesses : LONG_RUN};
+  if (op.num_accesses >= LONG_RUN) {
+    grow_array((void **)&long_runs, &long_runs_capacity, num_long_runs,
+               sizeof(*long_runs));
+    long_runs[num_long_runs++] =
+        (struct long_run){.index = index, .num_accesses = op.num_accesses};
+  }
+}
+
+// Reads the whole trace into condensed_mem_accesses, condensing it as it's
+// parsed so the raw accesses are never all in memory. Accesses to pages which
+// aren't sampled are dropped, merging the ones which become consecutive
+// accesses to the same page. Returns the number of raw accesses.
+long read_condensed_accesses(FILE *file) {
+  long capacity = INIT_SIZE;
+  condensed_mem_accesses =
+      alloc_or_die(capacity * sizeof(struct packed_memory_op));
+  long_runs_capacity = INIT_SIZE;
+  long_runs = alloc_or_die(long_runs_capacity * sizeof(struct long_run));
+
+  long num_accesses = 0;
+  struct access_stream stream;
+  open_access_stream(&stream, file);
+  struct condensed_memory_op op, pending = {.page_num = -1};
+  while (next_condensed_access(&stream, &op)) {
+    num_accesses += op.num_accesses;
+    if (cmdline_args.sample_rate < 1 && !page_sampled(op.page_num)) {
+      continue;
+    }
+    if (op.page_num == pending.page_num) {
+      pending.read = pending.read || op.read;
+      pending.write = pending.write || op.write;
+      pending.num_accesses += op.num_accesses;
+    } else {
+      if (pending.page_num != -1) {
+        add_condensed_access(pending, &capacity);
+      }
+      pending = op;
+    }
+  }
+  if (pending.page_num != -1) {
+    add_condensed_access(pending, &capacity);
+  }
+
+  condensed_mem_accesses =
+      realloc(condensed_mem_accesses, lmax(num_condensed_accesses, 1) *
+                                          sizeof(struct packed_memory_op));
+  return num_accesses;
+}
+
+// The estimated miss ratio is a ratio of sums over the sampled pages. Its
+// standard error follows from the spread of the per page residuals
+// misses - ratio * accesses, as for any ratio estimator under cluster
+// sampling. This only covers the error from which pages got sampled, not from
+// simulating fewer frames.
+void print_sampled_stats() {
+  double ratio = sampled_accesses ? (double)stats.num_misses / sampled_accesses
+                                  : 0;
+  double sum_sq = 0;
+  long num_accessed = 0;
+  for (int i = 0; i < num_pages; i++) {
+    if (page_accesses[i]) {
+      double residual = page_misses[i] - ratio * page_accesses[i];
+      sum_sq += residual * residual;
+      num_accessed++;
+    }
+  }
+  double std_err = 0;
+  if (num_accessed > 1) {
+    std_err = sqrt((1 - cmdline_args.sample_rate) * sum_sq * num_accessed /
+                   (num_accessed - 1)) /
+              sampled_accesses;
+  }
+
+  printf("Sampling rate: %g\n", cmdline_args.sample_rate);
+  printf("Number of frames simulated: %d\n", cmdline_args.num_frames);
+  printf("Number of sampled memory accesses: %ld\n", sampled_accesses);
+  printf("Estimated miss ratio: %.6f +- %.6f (95%% confidence)\n", ratio,
+         1.96 * std_err);
+  printf("Estimated number of misses: %.0f\n", ratio * stats.mem_accesses);
+}
+
+// Fenwick tree over positions in condensed_mem_accesses. The position of the
+// latest access to each page is set to 1, so the number of distinct pages
+// accessed in a range of positions is the sum over it.
+struct fenwick {
+  long size;
+  int *tree;
+};
+
+void fenwick_add(struct fenwick *fw, long pos, int delta) {
+  for (pos++; pos <= fw->size; pos += pos & -pos) {
+    fw->tree[pos] += delta;
+  }
+}
+
+// Sum over positions [0, pos]
+int fenwick_prefix_sum(struct fenwick *fw, long pos) {
+  int sum = 0;
+  for (pos++; pos > 0; pos -= pos & -pos) {
+    sum += fw->tree[pos];
+  }
+  return sum;
+}
+
+// Reuse distances d go in bucket 0 if d = 0 and floor(log2(d)) + 1 otherwise,
+// so bucket b > 0 has distances in [2^(b - 1), 2^b - 1]
+#define NUM_DISTANCE_BUCKETS (ADDR_BITS - BASE_PAGE_SIZE_BITS + 2)
+
+int distance_bucket(int distance) {
+  return distance ? 32 - __builtin_clz(distance) : 0;
+}
+
+// First index in done_after[0..num] with a value greater than time, where
+// done_after[i] is the number of accesses done after condensed access i
+long first_done_after(long *done_after, long num, long time) {
+  long lo = 0, hi = num;
+  while (lo < hi) {
+    long mid = lo + (hi - lo) / 2;
+    if (done_after[mid] > time) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+// Goes over the trace once, finding the reuse distance of each access (the
+// number of distinct pages accessed since the last access to the same page)
+// and, every sample_interval accesses, the working set size W(t, tau): the
+// number of distinct pages accessed in the last tau accesses. Both are range
+// counts on the Fenwick tree, so this takes O(N log N).
+//
+// When sampling pages, distances, page counts and times are scaled up by
+// 1 / rate to estimate those of the full trace.
+void analyze_trace() {
+  long n = num_condensed_accesses;
+  double scale = 1 / cmdline_args.sample_rate;
+  struct fenwick fw = {.size = n,
+                       .tree = alloc_or_die((lmax(n, 1) + 1) * sizeof(int))};
+  long *done_after = alloc_or_die(lmax(n, 1) * sizeof(long));
+  long *last_access = alloc_or_die(num_pages * sizeof(long));
+  for (int i = 0; i < num_pages; i++) {
+    last_access[i] = -1;
+  }
+  long histogram[NUM_DISTANCE_BUCKETS] = {0};
+  int num_distinct = 0;
+
+  printf("Working set sizes\nt");
+  for (int i = 0; i < cmdline_args.num_taus; i++) {
+    printf(",tau=%ld", cmdline_args.taus[i]);
+  }
+  printf("\n");
+
+  long accesses_done = 0;
+  long next_sample = cmdline_args.sample_interval;
+  for (long i = 0; i < n; i++) {
+    int page_num = condensed_mem_accesses[i].page_num;
+    long last = last_access[page_num];
+    if (last == -1) {
+      num_distinct++;
+    } else {
+      int distance =
+          fenwick_prefix_sum(&fw, i - 1) - fenwick_prefix_sum(&fw, last);
+      histogram[distance_bucket(min(distance * scale, MAX_FRAMES))]++;
+      fenwick_add(&fw, last, -1);
+    }
+    fenwick_add(&fw, i, 1);
+    last_access[page_num] = i;
+
+    accesses_done += condensed_access(i).num_accesses;
+    long time = accesses_done * scale;
+    done_after[i] = time;
+    // A condensed access counts as happening at the time of its last access
+    while (time >= next_sample) {
+      printf("%ld", next_sample);
+      int pages_till_now = fenwick_prefix_sum(&fw, i);
+      for (int j = 0; j < cmdline_args.num_taus; j++) {
+        long from = first_done_after(done_after, i,
+                                    next_sample - cmdline_args.taus[j]);
+        int pages_before = from ? fenwick_prefix_sum(&fw, from - 1) : 0;
+        printf(",%.0f", (pages_till_now - pages_before) * scale);
+      }
+      printf("\n");
+      next_sample += cmdline_args.sample_interval;
+    }
+  }
+
+  printf("\nNumber of memory accesses: %ld\n", stats.mem_accesses);
+  printf("Number of distinct pages: %.0f\n", num_distinct * scale);
+
+  printf("\nReuse distance histogram\nmin_distance,max_distance,count\n");
+  for (int b = 0; b < NUM_DISTANCE_BUCKETS; b++) {
+    if (histogram[b]) {
+      printf("%d,%d,%.0f\n", b ? 1 << (b - 1) : 0, b ? (1 << b) - 1 : 0,
+             histogram[b] * scale);
+    }
+  }
+
+  // An access hits under LRU iff its reuse distance is less than the number
+  // of frames, so the histogram gives LRU's misses for any number of frames.
+  printf("\nLRU misses\nframes,misses\n");
+  long misses = n;
+  for (int b = 0; b < NUM_DISTANCE_BUCKETS - 1; b++) {
+    misses -= histogram[b];
+    printf("%d,%.0f\n", 1 << b, misses * scale);
+  }
+
+  free(fw.tree);
+  free(done_after);
+  free(last_access);
+}
+
+/* ------------------------------ Checkpoints ------------------------------ */
+
+// A checkpoint starts with this header. The simulation continues with the
+// condensed access at index next_access. When streaming, the stats saved in it
+// tell how many accesses to skip to get there.
+const char CHECKPOINT_MAGIC[8] = "FRMCKPT2";
+
+struct checkpoint_header {
+  char magic[8];
+  char policy[16];
+  int num_pages;
+  int num_frames;
+  int num_procs;
+  int partition;
+  bool streaming;
+  int sections; // Which optional parts of the state it has
+  int window_size;
+  int num_tlb_levels;
+  struct tlb_config tlb_levels[MAX_TLB_LEVELS];
+  char prefetcher[16]; // Empty if not prefetching
+  long next_access;
+};
+
+struct checkpoint_header resumed; // Header of the checkpoint resumed from
+
+struct {
+  long next_run; // Number of accesses done when the next checkpoint is written
+} checkpoint;
+
+// Puts the resident pages back into new instances of the policy, starting from
+// the least recently accessed one, since policy state can't be carried over
+// between policies
+void rebuild_policy_state() {
+  for (int proc = 0; proc < cmdline_args.num_procs; proc++) {
+    if (cmdline_args.partition != GLOBAL) {
+      switch_to_process(proc);
+    } else if (proc > 0) {
+      break;
+    }
+    int resident = min(next_free_frame, num_frames);
+    struct page_table_entry **ptes =
+        alloc_or_die(max(resident, 1) * sizeof(ptes[0]));
+    memcpy(ptes, frame_list, resident * sizeof(ptes[0]));
+    qsort(ptes, resident, sizeof(ptes[0]), compare_last_access);
+    for (int i = 0; i < resident; i++) {
+      if (cmdline_args.policy->on_fault) {
+        cmdline_args.policy->on_fault(policy_state, ptes[i]);
+      }
+    }
+    free(ptes);
+  }
+}
+
+// Everything which changes as the simulation goes, and which the options given
+// say is in use. Policy states come last, as they're only read when resuming
+// with the same policy.
+void snapshot_simulation(struct snapshot *snap, bool same_policy) {
+  SNAPSHOT_FIELD(snap, stats);
+  SNAPSHOT_FIELD(snap, accesses_done);
+  if (cmdline_args.window_size) {
+    SNAPSHOT_FIELD(snap, window);
+  }
+  if (page_accesses) {
+    SNAPSHOT_FIELD(snap, sampled_accesses);
+    snapshot_data(snap, page_accesses, num_pages * sizeof(long));
+    snapshot_data(snap, page_misses, num_pages * sizeof(long));
+  }
+  if (cmdline_args.mixed_pages) {
+    SNAPSHOT_FIELD(snap, huge_stats);
+    snapshot_data(snap, regions,
+                  (num_pages >> HUGE_PAGE_BITS) * sizeof(struct region));
+  }
+  if (cmdline_args.num_tlb_levels) {
+    SNAPSHOT_FIELD(snap, tlb_clock);
+    SNAPSHOT_FIELD(snap, page_walks);
+    SNAPSHOT_FIELD(snap, tlb_random_state);
+    for (int i = 0; i < cmdline_args.num_tlb_levels; i++) {
+      SNAPSHOT_FIELD(snap, tlbs[i].lookups);
+      SNAPSHOT_FIELD(snap, tlbs[i].hits);
+      struct tlb_array *arrays[] = {&tlbs[i].base, &tlbs[i].huge};
+      for (int j = 0; j < 2; j++) {
+        long num_entries = (long)arrays[j]->sets * arrays[j]->ways;
+        snapshot_data(snap, arrays[j]->tags, num_entries * sizeof(int));
+        snapshot_data(snap, arrays[j]->last_used, num_entries * sizeof(long));
+      }
+    }
+  }
+  if (cmdline_args.flush_interval) {
+    // The dirty pages in the order they got dirty
+    SNAPSHOT_FIELD(snap, flusher.next_run);
+    int num_dirty = flusher.dirty.size;
+    SNAPSHOT_FIELD(snap, num_dirty);
+    int page_num = flusher.dirty.head;
+    for (int i = 0; i < num_dirty; i++) {
+      if (snap->saving) {
+        SNAPSHOT_FIELD(snap, page_num);
+        page_num = flusher.next[page_num];
+      } else {
+        SNAPSHOT_FIELD(snap, page_num);
+        page_list_push_back(&flusher.dirty, page_num);
+      }
+    }
+  }
+  if (cmdline_args.partition == WORKING_SET) {
+    SNAPSHOT_FIELD(snap, rebalance.next_run);
+    SNAPSHOT_FIELD(snap, rebalance.epoch);
+    snapshot_data(snap, rebalance.last_epoch, num_pages * sizeof(int));
+  }
+  SNAPSHOT_FIELD(snap, checkpoint.next_run);
+  // The state of rand() can't be saved, so it is brought back by drawing as
+  // many numbers again
+  SNAPSHOT_FIELD(snap, num_random_draws);
+  for (long i = 0; !snap->saving && i < num_random_draws; i++) {
+    rand();
+  }
+
+  // Pages in memory, which give the frame lists too
+  int num_resident = 0;
+  for (int i = 0; snap->saving && i < num_pages; i++) {
+    num_resident += page_table[i].valid;
+  }
+  SNAPSHOT_FIELD(snap, num_resident);
+  for (int i = 0, page_num = 0; i < num_resident; i++, page_num++) {
+    while (snap->saving && !page_table[page_num].valid) {
+      page_num++;
+    }
+    SNAPSHOT_FIELD(snap, page_num);
+    if (page_num < 0 || page_num >= num_pages) {
+      fprintf(stderr, "Checkpoint is corrupted\n");
+      exit(1);
+    }
+    struct page_table_entry *pte = &page_table[page_num];
+    SNAPSHOT_FIELD(snap, *pte);
+    if (cmdline_args.partition == GLOBAL) {
+      frame_list[pte->frame_num] = pte;
+    } else {
+      procs[page_num >> vpn_bits].frame_list[pte->frame_num] = pte;
+    }
+  }
+
+  procs[curr_proc].next_free_frame = next_free_frame;
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    SNAPSHOT_FIELD(snap, procs[i].num_accesses);
+    SNAPSHOT_FIELD(snap, procs[i].num_misses);
+    SNAPSHOT_FIELD(snap, procs[i].num_frames);
+    SNAPSHOT_FIELD(snap, procs[i].next_free_frame);
+    SNAPSHOT_FIELD(snap, procs[i].ws_size);
+  }
+  if (!snap->saving && cmdline_args.partition == GLOBAL) {
+    next_free_frame = procs[0].next_free_frame;
+  } else if (!snap->saving) {
+    // Each process gets back the number of frames it had
+    for (int i = 0; i < cmdline_args.num_procs; i++) {
+      cmdline_args.policy->cleanup(procs[i].policy_state);
+      procs[i].policy_state = cmdline_args.policy->init(procs[i].num_frames);
+    }
+    curr_proc = 0;
+    next_free_frame = procs[0].next_free_frame;
+    num_frames = procs[0].num_frames;
+    frame_list = procs[0].frame_list;
+    policy_state = procs[0].policy_state;
+  }
+
+  if (cmdline_args.prefetcher) {
+    cmdline_args.prefetcher->snapshot(prefetcher_state, snap);
+  }
+  if (!same_policy) {
+    rebuild_policy_state();
+    return;
+  }
+  if (!cmdline_args.policy->snapshot) {
+    return;
+  }
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    if (cmdline_args.partition != GLOBAL) {
+      cmdline_args.policy->snapshot(procs[i].policy_state, snap);
+    } else if (i == 0) {
+      cmdline_args.policy->snapshot(policy_state, snap);
+    }
+  }
+}
+
+struct checkpoint_header make_checkpoint_header() {
+  struct checkpoint_header header = {
+      .num_pages = num_pages,
+      .num_frames = cmdline_args.num_frames,
+      .num_procs = cmdline_args.num_procs,
+      .partition = cmdline_args.partition,
+      .streaming = cmdline_args.streaming,
+      .sections = (cmdline_args.sample_rate < 1) |
+                  cmdline_args.mixed_pages << 1 |
+                  (cmdline_args.flush_interval != 0) << 2,
+      .window_size = cmdline_args.window_size,
+      .num_tlb_levels = cmdline_args.num_tlb_levels,
+      .next_access = curr_access + 1};
+  memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+  strncpy(header.policy, cmdline_args.policy->name, sizeof(header.policy) - 1);
+  memcpy(header.tlb_levels, cmdline_args.tlb_levels,
+         sizeof(header.tlb_levels));
+  if (cmdline_args.prefetcher) {
+    strncpy(header.prefetcher, cmdline_args.prefetcher->name,
+            sizeof(header.prefetcher) - 1);
+  }
+  return header;
+}
+
+// The TLB arrays are saved with the sizes they have, so they can only be read
+// back into TLBs of the same shape
+bool same_tlbs(const struct checkpoint_header *a,
+               const struct checkpoint_header *b) {
+  if (a->num_tlb_levels != b->num_tlb_levels) {
+    return false;
+  }
+  for (int i = 0; i < a->num_tlb_levels; i++) {
+    const struct tlb_config *x = &a->tlb_levels[i], *y = &b->tlb_levels[i];
+    if (x->sets != y->sets || x->ways != y->ways || x->random != y->random ||
+        x->huge_sets != y->huge_sets || x->huge_ways != y->huge_ways) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Written to a temporary file first, so that a crash while writing it leaves
+// the previous checkpoint intact
+void save_checkpoint() {
+  while (checkpoint.next_run <= accesses_done) {
+    checkpoint.next_run += cmdline_args.checkpoint_interval;
+  }
+
+  size_t len = strlen(cmdline_args.checkpoint_file);
+  char *tmp_name = alloc_or_die(len + 5);
+  memcpy(tmp_name, cmdline_args.checkpoint_file, len);
+  memcpy(tmp_name + len, ".tmp", 5);
+  if (cmdline_args.window_size) {
+    fflush(cmdline_args.window_file);
+    window.file_offset = ftell(cmdline_args.window_file);
+  }
+  struct snapshot snap = {.file = fopen(tmp_name, "wb"), .saving = true};
+  if (!snap.file) {
+    perror("Opening checkpoint file");
+    exit(1);
+  }
+  struct checkpoint_header header = make_checkpoint_header();
+  SNAPSHOT_FIELD(&snap, header);
+  snapshot_simulation(&snap, true);
+  if (fclose(snap.file) || rename(tmp_name, cmdline_args.checkpoint_file)) {
+    perror("Writing checkpoint");
+    exit(1);
+  }
+  free(tmp_name);
+}
+
+FILE *resume_file;
+
+// Reads the header of the checkpoint to resume from, so that the policy can be
+// set up to start where it left off. The rest is read by finish_resume, once
+// everything is set up.
+void start_resume() {
+  resume_file = fopen(cmdline_args.resume_file, "rb");
+  if (!resume_file) {
+    perror("Opening checkpoint to resume from");
+    exit(1);
+  }
+  struct snapshot snap = {.file = resume_file, .saving = false};
+  SNAPSHOT_FIELD(&snap, resumed);
+  struct checkpoint_header expected = make_checkpoint_header();
+  if (memcmp(resumed.magic, CHECKPOINT_MAGIC, sizeof(resumed.magic)) != 0) {
+    fprintf(stderr, "%s isn't a checkpoint\n", cmdline_args.resume_file);
+    exit(1);
+  }
+  if (resumed.num_pages != expected.num_pages ||
+      resumed.num_frames != expected.num_frames ||
+      resumed.num_procs != expected.num_procs ||
+      resumed.partition != expected.partition ||
+      resumed.streaming != expected.streaming ||
+      resumed.sections != expected.sections ||
+      resumed.window_size != expected.window_size ||
+      !same_tlbs(&resumed, &expected) ||
+      strncmp(resumed.prefetcher, expected.prefetcher,
+              sizeof(resumed.prefetcher)) != 0) {
+    fprintf(stderr, "Checkpoint was made with different options\n");
+    exit(1);
+  }
+  curr_access = resumed.next_access;
+}
+
+void finish_resume() {
+  struct snapshot snap = {.file = resume_file, .saving = false};
+  bool same_policy =
+      strncmp(resumed.policy, cmdline_args.policy->name,
+              sizeof(resumed.policy)) == 0;
+  snapshot_simulation(&snap, same_policy);
+  if (fclose(resume_file)) {
+    perror("fclose");
+  }
+  if (cmdline_args.window_size) {
+    resume_windows();
+  }
+}
+
+void init() {
+  srand(5635);
+  num_frames = cmdline_args.num_frames;
+  if (cmdline_args.partition == GLOBAL) {
+    frame_list = malloc(num_frames * sizeof(struct page_table_entry *));
+  }
+  if (!cmdline_args.input_file) {
+    open_merged_traces();
+  }
+  page_table = alloc_or_die(num_pages * sizeof(struct page_table_entry));
+  init_event_logs();
+  init_tlbs();
+  if (cmdline_args.mixed_pages) {
+    regions = alloc_or_die((num_pages >> HUGE_PAGE_BITS) * sizeof(struct region));
+  }
+  if (cmdline_args.prefetcher) {
+    prefetcher_state = cmdline_args.prefetcher->init();
+  }
+  if (cmdline_args.flush_interval) {
+    init_flusher();
+  }
+}
+
+void start_simulation() {
+  if (cmdline_args.sample_rate < 1) {
+    page_accesses = alloc_or_die(num_pages * sizeof(long));
+    page_misses = alloc_or_die(num_pages * sizeof(long));
+  }
+  if (cmdline_args.window_size) {
+    start_windows();
+  }
+  checkpoint.next_run = cmdline_args.checkpoint_interval;
+}
+
+void finish_simulation() {
+  if (cmdline_args.window_size) {
+    finish_windows(accesses_done);
+  }
+  flush_event_logs();
+  print_stats();
+  if (cmdline_args.num_procs > 1) {
+    print_process_stats();
+  }
+  if (cmdline_args.sample_rate < 1) {
+    print_sampled_stats();
+  }
+  if (cmdline_args.page_size_given) {
+    print_page_size_stats();
+  }
+  if (cmdline_args.prefetcher) {
+    print_prefetch_stats();
+  }
+  if (cmdline_args.latency_given) {
+    print_latency_stats();
+  }
+  if (cmdline_args.num_tlb_levels) {
+    print_tlb_stats();
+  }
+  free(page_accesses);
+  free(page_misses);
+}
+
+void cleanup() {
+  if (cmdline_args.policy) {
+    cleanup_policy();
+  }
+  cleanup_tlbs();
+  free(regions);
+  if (cmdline_args.prefetcher) {
+    cmdline_args.prefetcher->cleanup(prefetcher_state);
+  }
+  free(flusher.prev);
+  free(flusher.next);
+  free(frame_list);
+  free(page_table);
+  for (int i = 0; i < cmdline_args.num_procs; i++) {
+    if (cmdline_args.trace_files[i] != stdin &&
+        fclose(cmdline_args.trace_files[i])) {
+      perror("fclose");
+    }
+  }
+  if (cmdline_args.event_log_file && fclose(cmdline_args.event_log_file)) {
+    perror("fclose");
+  }
+}
+
+void simulate_access(struct condensed_memory_op op) {
+  int proc = op.page_num >> vpn_bits;
+  long misses_before = stats.num_misses;
+  if (cmdline_args.num_procs > 1) {
+    switch_to_process(proc);
+  }
+  if (cmdline_args.partition == WORKING_SET) {
+    if (rebalance.last_epoch[op.page_num] != rebalance.epoch) {
+      rebalance.last_epoch[op.page_num] = rebalance.epoch;
+      procs[proc].ws_size++;
+    }
+  }
+
+  perform_op(op);
+  accesses_done += op.num_accesses;
+  procs[proc].num_accesses += op.num_accesses;
+  procs[proc].num_misses += stats.num_misses - misses_before;
+  if (page_accesses) {
+    page_accesses[op.page_num] += op.num_accesses;
+    sampled_accesses += op.num_accesses;
+  }
+  if (cmdline_args.window_size && accesses_done >= window.next_end) {
+    end_window(accesses_done);
+  }
+  if (cmdline_args.flush_interval && accesses_done >= flusher.next_run) {
+    run_flusher(accesses_done);
+  }
+  if (cmdline_args.partition == WORKING_SET &&
+      accesses_done >= rebalance.next_run) {
+    rebalance_frames(accesses_done);
+  }
+  if (cmdline_args.checkpoint_interval && accesses_done >= checkpoint.next_run) {
+    save_checkpoint();
+  }
+}
+
+// Simulates accesses as they're read. Accesses are kept waiting in a ring
+// buffer only for as long as the policy wants to look ahead at them, so memory
+// use doesn't grow with the trace.
+void simulate_stream() {
+  void (*on_future_access)(void *, int, long) =
+      cmdline_args.policy->on_future_access;
+  long window = on_future_access ? cmdline_args.lookahead : 0;
+  struct condensed_memory_op *pending =
+      alloc_or_die((window + 1) * sizeof(struct condensed_memory_op));
+  long num_read = curr_access;
+
+  // When resuming, the accesses read before the checkpoint are skipped
+  for (long i = 0; i < stats.mem_accesses; i++) {
+    next_access(cmdline_args.input_file);
+  }
+  struct access_stream stream;
+  open_access_stream(&stream, cmdline_args.input_file);
+  struct condensed_memory_op op;
+  while (next_condensed_access(&stream, &op)) {
+    stats.mem_accesses += op.num_accesses;
+    if (cmdline_args.sample_rate < 1 && !page_sampled(op.page_num)) {
+      continue;
+    }
+
+    pending[num_read % (window + 1)] = op;
+    if (on_future_access) {
+      on_future_access(policy_state_of(op.page_num), op.page_num, num_read);
+    }
+    num_read++;
+    if (num_read - curr_access > window) {
+      simulate_access(pending[curr_access % (window + 1)]);
+      curr_access++;
+    }
+  }
+
+  for (; curr_access < num_read; curr_access++) {
+    simulate_access(pending[curr_access % (window + 1)]);
+  }
+  free(pending);
+}
+
+int main(int argc, char *argv[]) {
+  cmdline_args = extract_cmdline_args(argc, argv);
+
+  if (!cmdline_args.analyze) {
+    init();
+  }
+
+  if (cmdline_args.streaming && !cmdline_args.analyze) {
+    if (cmdline_args.resume_file) {
+      start_resume();
+    }
+    init_policy();
+    start_simulation();
+    if (cmdline_args.resume_file) {
+      finish_resume();
+    }
+    simulate_stream();
+    finish_simulation();
+    cleanup();
+    return 0;
+  }
+
+  long num_accesses = read_condensed_accesses(cmdline_args.input_file);
+  stats.mem_accesses = num_accesses;
+
+  if (cmdline_args.analyze) {
+    analyze_trace();
+    free(condensed_mem_accesses);
+    free(long_runs);
+    cleanup();
+    return 0;
+  }
+
+  // Policies like OPT look at the whole trace, so they're set up after it is
+  // read
+  if (cmdline_args.resume_file) {
+    start_resume();
+  }
+  init_policy();
+  start_simulation();
+  if (cmdline_args.resume_file) {
+    finish_resume();
+    stats.mem_accesses = num_accesses;
+  }
+  for (; curr_access < num_condensed_accesses; curr_access++) {
+    simulate_access(condensed_access(curr_access));
+  }
+  finish_simulation();
+
+  free(condensed_mem_accesses);
+  free(long_runs);
   cleanup();
-}
\ No newline at end of file
+}
@@ -0,0 +1,107 @@
+# Generates a synthetic trace in the format read by frames, as a sequence of
+# phases each with its own access pattern
+#
+# Usage: python3 gen_trace.py [-seed <n>] <phase>... > <tracefile>
+#
+# A phase is <pattern>:<accesses>[:<param>=<value>...] where pattern is one of
+#   zipf    pages drawn from a Zipfian distribution, so a small hot set gets most
+#           of the accesses. Params: pages (default 10000), alpha (default 1.0)
+#   scan    a single sequential pass. Params: pages (default: one per access)
+#   loop    sequential passes over the same pages again and again, e.g. a few
+#           more pages than there are frames. Params: pages (default 1000)
+#   uniform pages drawn uniformly. Params: pages (default 10000)
+# All of them also take
+#   writes  fraction of accesses which are writes (default 0.3)
+#   offset  first page of the pages the phase accesses (default 0), so that
+#           phases can access different parts of memory
+#
+# For example, a hot set and then a loop a little too large for 1000 frames:
+#   python3 gen_trace.py zipf:1000000:pages=50000 loop:500000:pages=1100
+import bisect
+import random
+import sys
+
+BASE = 0x40000000
+PAGE_SIZE = 4096
+
+
+def usage():
+    sys.exit("Usage: python3 gen_trace.py [-seed <n>] <phase>...\n"
+             "  phase: <zipf|scan|loop|uniform>:<accesses>[:<param>=<value>...]")
+
+
+def parse_phase(spec):
+    fields = spec.split(":")
+    if len(fields) < 2 or fields[0] not in PATTERNS:
+        usage()
+    params = {}
+    for field in fields[2:]:
+        name, _, value = field.partition("=")
+        params[name] = float(value)
+    return fields[0], int(fields[1]), params
+
+
+def zipf_pages(rng, n, params):
+    num_pages = int(params.get("pages", 10000))
+    alpha = params.get("alpha", 1.0)
+    cdf = []
+    total = 0.0
+    for rank in range(1, num_pages + 1):
+        total += rank ** -alpha
+        cdf.append(total)
+    # Hot pages are spread out instead of being the first few
+    pages = list(range(num_pages))
+    rng.shuffle(pages)
+    for _ in range(n):
+        yield pages[min(bisect.bisect(cdf, rng.random() * total), num_pages - 1)]
+
+
+def scan_pages(rng, n, params):
+    num_pages = int(params.get("pages", n))
+    for i in range(n):
+        yield i * num_pages // n
+
+
+def loop_pages(rng, n, params):
+    num_pages = int(params.get("pages", 1000))
+    for i in range(n):
+        yield i % num_pages
+
+
+def uniform_pages(rng, n, params):
+    num_pages = int(params.get("pages", 10000))
+    for _ in range(n):
+        yield rng.randrange(num_pages)
+
+
+PATTERNS = {
+    "zipf": zipf_pages,
+    "scan": scan_pages,
+    "loop": loop_pages,
+    "uniform": uniform_pages,
+}
+
+args = sys.argv[1:]
+seed = 0
+if args[:1] == ["-seed"]:
+    if len(args) < 2:
+        usage()
+    seed = int(args[1])
+    args = args[2:]
+if not args:
+    usage()
+
+rng = random.Random(seed)
+out = sys.stdout
+for spec in args:
+    pattern, n, params = parse_phase(spec)
+    writes = params.get("writes", 0.3)
+    base = BASE + int(params.get("offset", 0)) * PAGE_SIZE
+    lines = []
+    for page in PATTERNS[pattern](rng, n, params):
+        addr = base + page * PAGE_SIZE + rng.randrange(PAGE_SIZE)
+        lines.append("0x%08x %s\n" % (addr, "W" if rng.random() < writes else "R"))
+        if len(lines) == 65536:
+            out.write("".join(lines))
+            lines = []
+    out.write("".join(lines))
@@ -0,0 +1,24 @@
+#!/bin/sh
+# Compares miss ratios estimated with -sample against exact runs, along with
+# the time each took.
+#
+# Usage: ./sample_check.sh <tracefile> <sampling rate> <policy> <frames>...
+
+trace=$1
+rate=$2
+policy=$3
+shift 3
+
+make > /dev/null
+echo "frames,exact,estimated,bound,error,exact_seconds,sampled_seconds"
+for num_frames in "$@"
+do	start=$(date +%s.%N)
+	exact=$(./frames $trace $num_frames $policy |
+		awk '/memory accesses/ {n = $5} /misses/ {m = $4} END {printf "%.6f", m / n}')
+	mid=$(date +%s.%N)
+	sampled=$(./frames $trace $num_frames $policy -sample $rate |
+		awk '/Estimated miss ratio/ {print $4 "," $6}')
+	end=$(date +%s.%N)
+	echo "$num_frames,$exact,$sampled" | awk -F, -v t1=$start -v t2=$mid -v t3=$end \
+		'{e = $3 - $2; if (e < 0) e = -e; printf "%s,%s,%s,%s,%.6f,%.2f,%.2f\n", $1, $2, $3, $4, e, t2 - t1, t3 - t2}'
+done
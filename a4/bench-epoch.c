@@ -0,0 +1,166 @@
+#include "epoch.h"
+#include "rwlock.h"
+#include <string.h>
+
+// Operations per second on a small config struct by <threads> threads, for
+// each given percentage of writes, with epoch-based reclamation and with the
+// rwlock it's built with. With epochs, readers copy the current version
+// through an atomic pointer, and writers publish a new version and retire the
+// old one. With the rwlock, both take the lock and work on the struct in
+// place.
+//
+// Usage: ./bench-epoch <threads> <seconds> <write %>...
+
+#ifndef LOCK_NAME
+#define LOCK_NAME "rwlock"
+#endif
+
+#define NUM_VALUES 8
+
+// Consistent when all the values are the same
+struct config {
+  long values[NUM_VALUES];
+};
+
+struct thread_stats {
+  _Alignas(64) long ops;
+  long torn_reads;
+  unsigned seed;
+};
+
+struct epoch_domain domain;
+_Atomic(struct config *) current;
+pthread_mutex_t writers_lock; // Writers of the epoch version still exclude
+                              // each other
+struct read_write_lock rwlock;
+struct config locked;
+bool use_epochs;
+int write_percent;
+volatile bool stop;
+
+bool consistent(struct config *c) {
+  for (int i = 1; i < NUM_VALUES; i++) {
+    if (c->values[i] != c->values[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void epoch_op(struct epoch_reader *r, bool write, struct config *copy) {
+  if (!write) {
+    EpochEnter(&domain, r);
+    *copy = *atomic_load_explicit(&current, memory_order_acquire);
+    EpochExit(r);
+    return;
+  }
+
+  struct config *next = malloc(sizeof(*next));
+  if (next == NULL) {
+    printf("Couldn't allocate memory for a config.\n");
+    exit(EXIT_FAILURE);
+  }
+  pthread_mutex_lock(&writers_lock);
+  struct config *old = atomic_load_explicit(&current, memory_order_relaxed);
+  for (int i = 0; i < NUM_VALUES; i++) {
+    next->values[i] = old->values[i] + 1;
+  }
+  atomic_store_explicit(&current, next, memory_order_release);
+  pthread_mutex_unlock(&writers_lock);
+  EpochRetire(&domain, old, free);
+}
+
+void rwlock_op(bool write, struct config *copy) {
+  if (!write) {
+    ReaderLock(&rwlock);
+    *copy = locked;
+    ReaderUnlock(&rwlock);
+    return;
+  }
+
+  WriterLock(&rwlock);
+  for (int i = 0; i < NUM_VALUES; i++) {
+    locked.values[i]++;
+  }
+  WriterUnlock(&rwlock);
+}
+
+void *Worker(void *arg) {
+  struct thread_stats *stats = arg;
+  struct epoch_reader reader;
+  EpochRegisterReader(&domain, &reader);
+  while (!stop) {
+    bool write = rand_r(&stats->seed) % 100 < write_percent;
+    struct config copy;
+    if (use_epochs) {
+      epoch_op(&reader, write, &copy);
+    } else {
+      rwlock_op(write, &copy);
+    }
+    if (!write && !consistent(&copy)) {
+      stats->torn_reads++;
+    }
+    stats->ops++;
+  }
+  EpochUnregisterReader(&domain, &reader);
+  return NULL;
+}
+
+// Returns the operations per second
+double run(int num_threads, double seconds, long *torn_reads) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  struct thread_stats *stats = calloc(num_threads, sizeof(*stats));
+  if (threads == NULL || stats == NULL) {
+    printf("Couldn't allocate memory for threads.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  stop = false;
+  for (int i = 0; i < num_threads; i++) {
+    stats[i].seed = i;
+    pthread_create(&threads[i], NULL, Worker, &stats[i]);
+  }
+  usleep(seconds * 1000000);
+  stop = true;
+  long ops = 0;
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+    ops += stats[i].ops;
+    *torn_reads += stats[i].torn_reads;
+  }
+
+  free(threads);
+  free(stats);
+  return ops / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    printf("Usage: %s <threads> <seconds> <write %%>...\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  int num_threads = atoi(argv[1]);
+  double seconds = atof(argv[2]);
+
+  InitializeEpochDomain(&domain);
+  atomic_init(&current, calloc(1, sizeof(struct config)));
+  pthread_mutex_init(&writers_lock, NULL);
+  InitalizeReadWriteLock(&rwlock);
+  long torn_reads = 0;
+  printf("%-8s %14s %14s\n", "write %", "epoch", LOCK_NAME);
+  for (int i = 3; i < argc; i++) {
+    write_percent = atoi(argv[i]);
+    use_epochs = true;
+    double epoch_ops = run(num_threads, seconds, &torn_reads);
+    use_epochs = false;
+    double rwlock_ops = run(num_threads, seconds, &torn_reads);
+    printf("%-8d %14.0f %14.0f\n", write_percent, epoch_ops, rwlock_ops);
+  }
+
+  free(atomic_load(&current));
+  DestroyEpochDomain(&domain);
+  if (torn_reads) {
+    printf("%ld reads saw a partly written config\n", torn_reads);
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,131 @@
+#include "rwlock.h"
+#include "seqlock.h"
+#include <string.h>
+
+// Reads per second of a small snapshot with 1 to <max readers> readers, under
+// the seqlock and under ReaderLock of the rwlock it's built with, while a
+// writer updates the snapshot <writes per second> times a second. With the
+// seqlock, readers don't write to shared memory, so their throughput should
+// grow with the number of cores.
+//
+// Usage: ./bench-seqlock <max readers> <seconds> <writes per second>
+
+#ifndef LOCK_NAME
+#define LOCK_NAME "rwlock"
+#endif
+
+#define NUM_VALUES 8
+
+// Consistent when all the values are the same
+struct snapshot {
+  long values[NUM_VALUES];
+};
+
+struct reader_stats {
+  _Alignas(64) long reads;
+  long torn_reads;
+};
+
+struct snapshot data;
+struct seqlock seqlock;
+struct read_write_lock rwlock;
+bool use_seqlock;
+long write_interval_us;
+volatile bool stop;
+
+void *Reader(void *arg) {
+  struct reader_stats *stats = arg;
+  struct snapshot copy;
+  while (!stop) {
+    if (use_seqlock) {
+      SeqLockRead(&seqlock, &copy, &data, sizeof(copy));
+    } else {
+      ReaderLock(&rwlock);
+      memcpy(&copy, &data, sizeof(copy));
+      ReaderUnlock(&rwlock);
+    }
+    for (int i = 1; i < NUM_VALUES; i++) {
+      if (copy.values[i] != copy.values[0]) {
+        stats->torn_reads++;
+        break;
+      }
+    }
+    stats->reads++;
+  }
+  return NULL;
+}
+
+void *Writer(void *arg) {
+  (void)arg;
+  struct snapshot next;
+  for (long version = 1; !stop; version++) {
+    usleep(write_interval_us);
+    for (int i = 0; i < NUM_VALUES; i++) {
+      next.values[i] = version;
+    }
+    if (use_seqlock) {
+      SeqLockWrite(&seqlock, &data, &next, sizeof(next));
+    } else {
+      WriterLock(&rwlock);
+      data = next;
+      WriterUnlock(&rwlock);
+    }
+  }
+  return NULL;
+}
+
+// Returns the reads per second
+double run(int num_readers, double seconds, long *torn_reads) {
+  pthread_t writer;
+  pthread_t *readers = malloc(num_readers * sizeof(pthread_t));
+  struct reader_stats *stats = calloc(num_readers, sizeof(*stats));
+  if (readers == NULL || stats == NULL) {
+    printf("Couldn't allocate memory for threads.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  stop = false;
+  pthread_create(&writer, NULL, Writer, NULL);
+  for (int i = 0; i < num_readers; i++) {
+    pthread_create(&readers[i], NULL, Reader, &stats[i]);
+  }
+  usleep(seconds * 1000000);
+  stop = true;
+  pthread_join(writer, NULL);
+  long reads = 0;
+  for (int i = 0; i < num_readers; i++) {
+    pthread_join(readers[i], NULL);
+    reads += stats[i].reads;
+    *torn_reads += stats[i].torn_reads;
+  }
+
+  free(readers);
+  free(stats);
+  return reads / seconds;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 4 || atol(argv[3]) <= 0) {
+    printf("Usage: %s <max readers> <seconds> <writes per second>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  int max_readers = atoi(argv[1]);
+  double seconds = atof(argv[2]);
+  write_interval_us = 1000000 / atol(argv[3]);
+
+  InitializeSeqLock(&seqlock);
+  InitalizeReadWriteLock(&rwlock);
+  long torn_reads = 0;
+  printf("%-8s %14s %14s\n", "readers", "seqlock", LOCK_NAME);
+  for (int readers = 1; readers <= max_readers; readers++) {
+    use_seqlock = true;
+    double seqlock_reads = run(readers, seconds, &torn_reads);
+    use_seqlock = false;
+    double rwlock_reads = run(readers, seconds, &torn_reads);
+    printf("%-8d %14.0f %14.0f\n", readers, seqlock_reads, rwlock_reads);
+  }
+  if (torn_reads) {
+    printf("%ld reads saw a partly written snapshot\n", torn_reads);
+    return EXIT_FAILURE;
+  }
+}
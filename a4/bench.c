@@ -0,0 +1,225 @@
+#include "rwlock.h"
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+// Benchmarks the lock it's built with over every combination of the given
+// thread counts, percentages of writes and critical section lengths. Each
+// thread takes the lock for reading or writing at random with the given
+// ratio, holds it for the critical section length, releases it, and then works
+// as long outside it. For each run and side this prints the operations per
+// second and acquire latency percentiles, in microseconds, as CSV. Built with
+// -DRWLOCK_STATS, it also writes the lock's statistics for each run to stderr.
+//
+// Usage: ./bench-<lock> <seconds per run> <threads,...> <write %,...>
+//                       <critical section ns,...>
+
+#ifndef LOCK_NAME
+#define LOCK_NAME "rwlock"
+#endif
+
+#define MAX_VALUES 32
+
+// Latencies are counted in a histogram with SUB_BUCKETS buckets for every
+// power of two nanoseconds, so percentiles are within 1/SUB_BUCKETS of the
+// real ones
+#define SUB_BUCKET_BITS 4
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define NUM_BUCKETS (64 * SUB_BUCKETS)
+
+struct histogram {
+  long counts[NUM_BUCKETS];
+  long total;
+  long max;
+};
+
+enum side { READER, WRITER };
+
+struct thread_stats {
+  long ops[2];
+  struct histogram latency[2];
+  unsigned seed;
+};
+
+struct read_write_lock rwlock;
+long critical_section_ns;
+int write_percent;
+volatile bool stop;
+
+long now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void spin_for(long ns) {
+  long end = now_ns() + ns;
+  while (now_ns() < end) {
+  }
+}
+
+int bucket_of(long ns) {
+  if (ns < SUB_BUCKETS) {
+    return ns;
+  }
+  int exp = 63 - __builtin_clzl(ns);
+  int sub = (ns >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// Lowest latency in the bucket
+long bucket_start(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int exp = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  return (long)(SUB_BUCKETS + bucket % SUB_BUCKETS) << (exp - SUB_BUCKET_BITS);
+}
+
+void histogram_add(struct histogram *h, long ns) {
+  h->counts[bucket_of(ns)]++;
+  h->total++;
+  if (ns > h->max) {
+    h->max = ns;
+  }
+}
+
+void histogram_merge(struct histogram *into, struct histogram *h) {
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    into->counts[i] += h->counts[i];
+  }
+  into->total += h->total;
+  if (h->max > into->max) {
+    into->max = h->max;
+  }
+}
+
+long percentile(struct histogram *h, double p) {
+  long rank = p * h->total;
+  long seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen > rank) {
+      return bucket_start(i);
+    }
+  }
+  return h->max;
+}
+
+void *worker(void *arg) {
+  struct thread_stats *stats = arg;
+  while (!stop) {
+    enum side side =
+        rand_r(&stats->seed) % 100 < write_percent ? WRITER : READER;
+    long start = now_ns();
+    if (side == WRITER) {
+      WriterLock(&rwlock);
+    } else {
+      ReaderLock(&rwlock);
+    }
+    histogram_add(&stats->latency[side], now_ns() - start);
+    spin_for(critical_section_ns);
+    if (side == WRITER) {
+      WriterUnlock(&rwlock);
+    } else {
+      ReaderUnlock(&rwlock);
+    }
+    stats->ops[side]++;
+    spin_for(critical_section_ns);
+  }
+  return NULL;
+}
+
+void print_side(int num_threads, enum side side, struct thread_stats *stats,
+                double seconds) {
+  struct histogram total;
+  memset(&total, 0, sizeof(total));
+  long ops = 0;
+  for (int i = 0; i < num_threads; i++) {
+    histogram_merge(&total, &stats[i].latency[side]);
+    ops += stats[i].ops[side];
+  }
+  if (ops == 0) {
+    return;
+  }
+  printf("%s,%d,%d,%ld,%s,%.0f,%.3f,%.3f,%.3f,%.3f\n", LOCK_NAME, num_threads,
+         write_percent, critical_section_ns,
+         side == WRITER ? "writer" : "reader", ops / seconds,
+         percentile(&total, 0.5) / 1000.0, percentile(&total, 0.99) / 1000.0,
+         percentile(&total, 0.999) / 1000.0, total.max / 1000.0);
+}
+
+void run(int num_threads, double seconds) {
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  struct thread_stats *stats = calloc(num_threads, sizeof(struct thread_stats));
+  if (threads == NULL || stats == NULL) {
+    printf("Couldn't allocate memory for threads.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  InitalizeReadWriteLock(&rwlock);
+  EnableLockStats(&rwlock);
+  stop = false;
+  for (int i = 0; i < num_threads; i++) {
+    stats[i].seed = i;
+    int ret = pthread_create(&threads[i], NULL, worker, &stats[i]);
+    if (ret) {
+      printf("Error - pthread_create() return code: %d\n", ret);
+      exit(EXIT_FAILURE);
+    }
+  }
+  usleep(seconds * 1000000);
+  stop = true;
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  print_side(num_threads, READER, stats, seconds);
+  print_side(num_threads, WRITER, stats, seconds);
+  fflush(stdout);
+#ifdef RWLOCK_STATS
+  fprintf(stderr, "%s, %d threads, %d%% writes, %ld ns:\n", LOCK_NAME,
+          num_threads, write_percent, critical_section_ns);
+  DumpLockStats(&rwlock, stderr);
+#endif
+  DestroyReadWriteLock(&rwlock);
+  free(threads);
+  free(stats);
+}
+
+// Parses a comma separated list into values, returning how many there are
+int parse_list(char *arg, long *values) {
+  int n = 0;
+  for (char *value = strtok(arg, ","); value && n < MAX_VALUES;
+       value = strtok(NULL, ",")) {
+    values[n++] = atol(value);
+  }
+  return n;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 5) {
+    fprintf(stderr,
+            "Usage: %s <seconds per run> <threads,...> <write %%,...> "
+            "<critical section ns,...>\n",
+            argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  double seconds = atof(argv[1]);
+  long threads[MAX_VALUES], writes[MAX_VALUES], lengths[MAX_VALUES];
+  int num_threads = parse_list(argv[2], threads);
+  int num_writes = parse_list(argv[3], writes);
+  int num_lengths = parse_list(argv[4], lengths);
+
+  printf("lock,threads,write_percent,critical_section_ns,side,ops_per_sec,"
+         "p50_us,p99_us,p999_us,max_us\n");
+  for (int t = 0; t < num_threads; t++) {
+    for (int w = 0; w < num_writes; w++) {
+      for (int l = 0; l < num_lengths; l++) {
+        write_percent = writes[w];
+        critical_section_ns = lengths[l];
+        run(threads[t], seconds);
+      }
+    }
+  }
+}
@@ -0,0 +1,125 @@
+#include "epoch.h"
+#include <sched.h>
+#include <stdlib.h>
+
+#define INSIDE 1
+// Retired objects are only reclaimed in batches, so that writers don't go over
+// all the readers every time
+#define RECLAIM_BATCH 32
+
+void InitializeEpochDomain(struct epoch_domain *d) {
+  atomic_init(&d->global_epoch, 0);
+  pthread_mutex_init(&d->lock, NULL);
+  d->readers = NULL;
+  d->retired = NULL;
+  d->num_retired = 0;
+}
+
+void DestroyEpochDomain(struct epoch_domain *d) {
+  while (d->retired) {
+    struct retired *next = d->retired->next;
+    d->retired->free_fn(d->retired->ptr);
+    free(d->retired);
+    d->retired = next;
+  }
+  pthread_mutex_destroy(&d->lock);
+}
+
+void EpochRegisterReader(struct epoch_domain *d, struct epoch_reader *r) {
+  atomic_init(&r->epoch, 0);
+  pthread_mutex_lock(&d->lock);
+  r->next = d->readers;
+  d->readers = r;
+  pthread_mutex_unlock(&d->lock);
+}
+
+void EpochUnregisterReader(struct epoch_domain *d, struct epoch_reader *r) {
+  pthread_mutex_lock(&d->lock);
+  struct epoch_reader **prev = &d->readers;
+  while (*prev != r) {
+    prev = &(*prev)->next;
+  }
+  *prev = r->next;
+  pthread_mutex_unlock(&d->lock);
+}
+
+void EpochEnter(struct epoch_domain *d, struct epoch_reader *r) {
+  unsigned long epoch = atomic_load(&d->global_epoch);
+  atomic_store_explicit(&r->epoch, epoch * 2 + INSIDE, memory_order_relaxed);
+  // Orders the store of the epoch before the loads of the data, so a writer
+  // advancing the epoch sees this reader or this reader sees the new data
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+void EpochExit(struct epoch_reader *r) {
+  atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+// Moves the global epoch on if every reader inside has seen it. Called with
+// lock held.
+static bool try_advance(struct epoch_domain *d) {
+  unsigned long epoch = atomic_load(&d->global_epoch);
+  atomic_thread_fence(memory_order_seq_cst);
+  for (struct epoch_reader *r = d->readers; r; r = r->next) {
+    unsigned long seen = atomic_load_explicit(&r->epoch, memory_order_acquire);
+    if ((seen & INSIDE) && seen / 2 != epoch) {
+      return false;
+    }
+  }
+  atomic_store(&d->global_epoch, epoch + 1);
+  return true;
+}
+
+// Frees what was retired two epochs before. Called with lock held.
+static void reclaim(struct epoch_domain *d) {
+  unsigned long epoch = atomic_load(&d->global_epoch);
+  struct retired **prev = &d->retired;
+  while (*prev && (*prev)->epoch + 2 > epoch) {
+    prev = &(*prev)->next;
+  }
+  struct retired *old = *prev;
+  *prev = NULL;
+  while (old) {
+    struct retired *next = old->next;
+    old->free_fn(old->ptr);
+    free(old);
+    d->num_retired--;
+    old = next;
+  }
+}
+
+void EpochRetire(struct epoch_domain *d, void *ptr, void (*free_fn)(void *)) {
+  struct retired *node = malloc(sizeof(*node));
+  if (node == NULL) {
+    // Nowhere to keep it, so wait until it can be freed now
+    EpochSynchronize(d);
+    free_fn(ptr);
+    return;
+  }
+  node->ptr = ptr;
+  node->free_fn = free_fn;
+
+  pthread_mutex_lock(&d->lock);
+  node->epoch = atomic_load(&d->global_epoch);
+  node->next = d->retired;
+  d->retired = node;
+  if (++d->num_retired >= RECLAIM_BATCH) {
+    try_advance(d);
+    reclaim(d);
+  }
+  pthread_mutex_unlock(&d->lock);
+}
+
+void EpochSynchronize(struct epoch_domain *d) {
+  pthread_mutex_lock(&d->lock);
+  unsigned long target = atomic_load(&d->global_epoch) + 2;
+  while (atomic_load(&d->global_epoch) < target) {
+    if (!try_advance(d)) {
+      pthread_mutex_unlock(&d->lock);
+      sched_yield();
+      pthread_mutex_lock(&d->lock);
+    }
+  }
+  reclaim(d);
+  pthread_mutex_unlock(&d->lock);
+}
@@ -0,0 +1,52 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Epoch-based reclamation, so that readers of data behind an atomic pointer
+// never wait for writers. A writer publishes a new version by storing the
+// pointer and retires the old one, which is freed once every reader that
+// could still see it has left its critical section.
+//
+// Each reader thread registers a struct epoch_reader of its own, and only
+// ever writes to it: entering a critical section records the global epoch
+// there, and leaving clears it. The global epoch moves on once every reader
+// inside a critical section has seen it, and what was retired two epochs
+// before can no longer be seen by anyone.
+
+struct epoch_reader {
+  _Alignas(64) atomic_ulong epoch; // Twice the epoch plus one while inside
+  struct epoch_reader *next;
+};
+
+struct retired {
+  void *ptr;
+  void (*free_fn)(void *);
+  unsigned long epoch; // Global epoch when it was retired
+  struct retired *next;
+};
+
+struct epoch_domain {
+  atomic_ulong global_epoch;
+  pthread_mutex_t lock; // lock for readers and retired
+  struct epoch_reader *readers;
+  struct retired *retired; // Newest first
+  int num_retired;
+};
+
+void InitializeEpochDomain(struct epoch_domain *d);
+// Frees everything still retired, once no reader is left
+void DestroyEpochDomain(struct epoch_domain *d);
+void EpochRegisterReader(struct epoch_domain *d, struct epoch_reader *r);
+void EpochUnregisterReader(struct epoch_domain *d, struct epoch_reader *r);
+
+// Pointers to published data loaded between EpochEnter and EpochExit, with
+// acquire loads, stay valid until EpochExit
+void EpochEnter(struct epoch_domain *d, struct epoch_reader *r);
+void EpochExit(struct epoch_reader *r);
+
+// Calls free_fn(ptr) once no reader can see ptr any more, after the writer
+// replaced the pointer to it with a release store
+void EpochRetire(struct epoch_domain *d, void *ptr, void (*free_fn)(void *));
+// Waits until every reader inside a critical section has left it, and frees
+// what was retired before
+void EpochSynchronize(struct epoch_domain *d);
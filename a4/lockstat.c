@@ -0,0 +1,51 @@
+#include "rwlock.h"
+
+void EnableLockStats(struct read_write_lock *rw) {
+#ifdef RWLOCK_STATS
+  atomic_store(&rw->stats.enabled, true);
+#else
+  (void)rw;
+#endif
+}
+
+void DumpLockStats(struct read_write_lock *rw, FILE *file) {
+#ifdef RWLOCK_STATS
+  struct lock_stats *s = &rw->stats;
+  if (!atomic_load(&s->enabled)) {
+    fprintf(file, "Lock statistics weren't enabled.\n");
+    return;
+  }
+  const char *names[] = {"Readers", "Writers"};
+  for (int side = LOCK_READER; side <= LOCK_WRITER; side++) {
+    long acquisitions = atomic_load(&s->acquisitions[side]);
+    long contended = atomic_load(&s->contended[side]);
+    fprintf(file, "%s: %ld acquisitions, %ld contended (%.1f%%)\n", names[side],
+            acquisitions, contended,
+            acquisitions ? 100.0 * contended / acquisitions : 0.0);
+  }
+  fprintf(file, "At most %d readers at once\n", atomic_load(&s->max_readers));
+
+  fprintf(file, "%-14s %12s %12s %12s %12s\n", "ns", "read wait", "read hold",
+          "write wait", "write hold");
+  for (int i = 0; i < LOCKSTAT_BUCKETS; i++) {
+    long counts[] = {atomic_load(&s->wait_ns[LOCK_READER][i]),
+                     atomic_load(&s->hold_ns[LOCK_READER][i]),
+                     atomic_load(&s->wait_ns[LOCK_WRITER][i]),
+                     atomic_load(&s->hold_ns[LOCK_WRITER][i])};
+    if (!(counts[0] || counts[1] || counts[2] || counts[3])) {
+      continue;
+    }
+    char range[16];
+    if (i == LOCKSTAT_BUCKETS - 1) {
+      snprintf(range, sizeof(range), ">= %ld", 1L << (i - 1));
+    } else {
+      snprintf(range, sizeof(range), "< %ld", 1L << i);
+    }
+    fprintf(file, "%-14s %12ld %12ld %12ld %12ld\n", range, counts[0],
+            counts[1], counts[2], counts[3]);
+  }
+#else
+  (void)rw;
+  fprintf(file, "Lock statistics need building with -DRWLOCK_STATS.\n");
+#endif
+}
@@ -0,0 +1,181 @@
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+// Contention statistics kept inside a read_write_lock when it's built with
+// -DRWLOCK_STATS and EnableLockStats has been called on it. Without
+// RWLOCK_STATS the hooks below compile to nothing, and with it they cost a
+// load and a branch until the statistics are enabled.
+//
+// An acquisition counts as contended when the lock was held in a conflicting
+// mode as it started, or for a writer, when another writer was waiting. Wait
+// and hold times go into histograms with a bucket for every power of two
+// nanoseconds. The hold time of a reader is that of its outermost read lock
+// on that lock; a thread tracks up to LOCKSTAT_HELD_LOCKS read-held locks at
+// once, and read locks beyond those, or taken before the statistics were
+// enabled, are counted but not timed.
+
+enum lock_side { LOCK_READER, LOCK_WRITER };
+
+#ifdef RWLOCK_STATS
+
+#define LOCKSTAT_BUCKETS 40
+
+struct lock_stats {
+  atomic_bool enabled;
+  atomic_long acquisitions[2];
+  atomic_long contended[2];
+  atomic_long waiting[2]; // Threads waiting on each side right now
+  atomic_int readers_inside;
+  atomic_int max_readers;
+  atomic_bool writer_inside;
+  atomic_long writer_acquired_at;
+  atomic_long wait_ns[2][LOCKSTAT_BUCKETS];
+  atomic_long hold_ns[2][LOCKSTAT_BUCKETS];
+};
+
+struct lockstat_wait {
+  long start; // 0 if the statistics aren't enabled
+  bool contended;
+};
+
+#define LOCKSTAT_HELD_LOCKS 8
+
+// The read locks this thread holds, keyed by their statistics
+struct lockstat_read_hold {
+  struct lock_stats *lock; // NULL if the entry is free
+  int depth;
+  long start;
+};
+
+static _Thread_local struct lockstat_read_hold
+    lockstat_holds[LOCKSTAT_HELD_LOCKS];
+
+// Returns the entry for s, claiming a free one if claim is set, or NULL
+static inline struct lockstat_read_hold *lockstat_hold(struct lock_stats *s,
+                                                       bool claim) {
+  struct lockstat_read_hold *free_hold = NULL;
+  for (int i = 0; i < LOCKSTAT_HELD_LOCKS; i++) {
+    if (lockstat_holds[i].lock == s) {
+      return &lockstat_holds[i];
+    }
+    if (!lockstat_holds[i].lock && !free_hold) {
+      free_hold = &lockstat_holds[i];
+    }
+  }
+  if (claim && free_hold) {
+    free_hold->lock = s;
+  }
+  return claim ? free_hold : NULL;
+}
+
+static inline long lockstat_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static inline void lockstat_add(atomic_long *histogram, long ns) {
+  int bucket = ns > 0 ? 64 - __builtin_clzl(ns) : 0;
+  atomic_fetch_add_explicit(
+      &histogram[bucket < LOCKSTAT_BUCKETS ? bucket : LOCKSTAT_BUCKETS - 1], 1,
+      memory_order_relaxed);
+}
+
+static inline struct lockstat_wait lockstat_begin(struct lock_stats *s,
+                                                  enum lock_side side) {
+  struct lockstat_wait wait = {0, false};
+  if (!atomic_load_explicit(&s->enabled, memory_order_relaxed)) {
+    return wait;
+  }
+  wait.contended = atomic_load(&s->writer_inside) ||
+                   (side == LOCK_WRITER && (atomic_load(&s->readers_inside) ||
+                                            atomic_load(&s->waiting[side])));
+  atomic_fetch_add(&s->waiting[side], 1);
+  wait.start = lockstat_now();
+  return wait;
+}
+
+static inline void lockstat_acquired(struct lock_stats *s, enum lock_side side,
+                                     struct lockstat_wait wait) {
+  if (!wait.start) {
+    return;
+  }
+  long now = lockstat_now();
+  atomic_fetch_sub(&s->waiting[side], 1);
+  atomic_fetch_add_explicit(&s->acquisitions[side], 1, memory_order_relaxed);
+  if (wait.contended) {
+    atomic_fetch_add_explicit(&s->contended[side], 1, memory_order_relaxed);
+  }
+  lockstat_add(s->wait_ns[side], now - wait.start);
+
+  if (side == LOCK_WRITER) {
+    atomic_store(&s->writer_inside, true);
+    atomic_store_explicit(&s->writer_acquired_at, now, memory_order_relaxed);
+    return;
+  }
+  struct lockstat_read_hold *hold = lockstat_hold(s, true);
+  if (!hold) {
+    return;
+  }
+  int readers = atomic_fetch_add(&s->readers_inside, 1) + 1;
+  int max = atomic_load_explicit(&s->max_readers, memory_order_relaxed);
+  while (readers > max &&
+         !atomic_compare_exchange_weak(&s->max_readers, &max, readers)) {
+  }
+  if (hold->depth++ == 0) {
+    hold->start = now;
+  }
+}
+
+static inline void lockstat_release(struct lock_stats *s, enum lock_side side) {
+  if (!atomic_load_explicit(&s->enabled, memory_order_relaxed)) {
+    return;
+  }
+  long now = lockstat_now();
+  if (side == LOCK_WRITER) {
+    // Not set if the lock was taken before the statistics were enabled
+    if (atomic_exchange(&s->writer_inside, false)) {
+      lockstat_add(s->hold_ns[LOCK_WRITER],
+                   now - atomic_load_explicit(&s->writer_acquired_at,
+                                              memory_order_relaxed));
+    }
+    return;
+  }
+  struct lockstat_read_hold *hold = lockstat_hold(s, false);
+  if (!hold) {
+    return;
+  }
+  atomic_fetch_sub(&s->readers_inside, 1);
+  if (--hold->depth == 0) {
+    lockstat_add(s->hold_ns[LOCK_READER], now - hold->start);
+    hold->lock = NULL;
+  }
+}
+
+#define LOCKSTAT_INIT(rw) memset(&(rw)->stats, 0, sizeof((rw)->stats))
+// LOCKSTAT_BEGIN starts timing a wait in the function it's in, which
+// LOCKSTAT_ACQUIRED ends
+#define LOCKSTAT_BEGIN(rw, side)                                               \
+  struct lockstat_wait lockstat_wait = lockstat_begin(&(rw)->stats, side)
+#define LOCKSTAT_ACQUIRED(rw, side)                                            \
+  lockstat_acquired(&(rw)->stats, side, lockstat_wait)
+#define LOCKSTAT_RELEASE(rw, side) lockstat_release(&(rw)->stats, side)
+// The writer turns into a reader without waiting
+#define LOCKSTAT_DOWNGRADE(rw)                                                 \
+  do {                                                                         \
+    LOCKSTAT_RELEASE(rw, LOCK_WRITER);                                         \
+    LOCKSTAT_BEGIN(rw, LOCK_READER);                                           \
+    LOCKSTAT_ACQUIRED(rw, LOCK_READER);                                        \
+  } while (0)
+
+#else
+
+#define LOCKSTAT_INIT(rw)
+#define LOCKSTAT_BEGIN(rw, side)
+#define LOCKSTAT_ACQUIRED(rw, side)
+#define LOCKSTAT_RELEASE(rw, side)
+#define LOCKSTAT_DOWNGRADE(rw)
+
+#endif
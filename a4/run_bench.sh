@@ -0,0 +1,17 @@
+# Usage: ./run_bench.sh [<seconds per run> <threads,...> <write %,...>
+#                        <critical section ns,...>]
+# Writes the results for every lock to bench.csv. CFLAGS=-DRWLOCK_STATS
+# also writes each lock's contention statistics to stderr.
+if [ $# -eq 0 ]; then
+  set -- 1 1,2,4,8 0,10,50 0,100,1000
+fi
+first=1
+for lock in reader-pref writer-pref futex distributed phase-fair; do
+  gcc -O2 $CFLAGS bench.c rwlock-$lock.c lockstat.c -o bench-$lock -DLOCK_NAME=\"$lock\" -lpthread
+  if [ $first -eq 1 ]; then
+    ./bench-$lock "$@"
+    first=0
+  else
+    ./bench-$lock "$@" | tail -n +2
+  fi
+done | tee bench.csv
@@ -0,0 +1,3 @@
+gcc test-writer-pref.c rwlock-distributed.c -o rwlock-distributed -lpthread
+
+./rwlock-distributed 5 1
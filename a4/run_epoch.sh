@@ -0,0 +1,5 @@
+# Usage: ./run_epoch.sh <threads> <seconds> <write %>...
+for lock in reader-pref writer-pref futex distributed phase-fair; do
+  gcc -O2 bench-epoch.c epoch.c rwlock-$lock.c -o bench-epoch-$lock -DLOCK_NAME=\"$lock\" -lpthread
+  ./bench-epoch-$lock "$@"
+done
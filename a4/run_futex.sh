@@ -0,0 +1,3 @@
+gcc test-writer-pref.c rwlock-futex.c -o rwlock-futex -lpthread
+
+./rwlock-futex 5 1
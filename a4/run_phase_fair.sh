@@ -0,0 +1,3 @@
+gcc test-writer-pref.c rwlock-phase-fair.c -o rwlock-phase-fair -lpthread
+
+./rwlock-phase-fair 5 1
@@ -0,0 +1,4 @@
+# Usage: ./run_seqlock.sh <max readers> <seconds> <writes per second>
+gcc -O2 bench-seqlock.c seqlock.c rwlock-futex.c -o bench-seqlock -DLOCK_NAME=\"futex\" -lpthread
+
+./bench-seqlock "$@"
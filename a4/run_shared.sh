@@ -0,0 +1,5 @@
+for lock in reader-pref writer-pref futex distributed phase-fair; do
+  gcc test-shared.c rwlock-$lock.c -o test-shared-$lock -lpthread
+  echo -n "$lock: "
+  ./test-shared-$lock 4 2
+done
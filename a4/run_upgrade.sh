@@ -0,0 +1,5 @@
+for lock in reader-pref writer-pref futex distributed phase-fair; do
+  gcc test-upgrade.c rwlock-$lock.c -o test-upgrade-$lock -lpthread
+  echo -n "$lock: "
+  ./test-upgrade-$lock 4 2 2
+done
@@ -0,0 +1,181 @@
+#include "rwlock.h"
+#include "shared.h"
+#include <stdbool.h>
+
+// Each thread counts itself as a reader in a slot of its own (shared once
+// there are more threads than slots), so readers only ever write to their own
+// cache line and read writer_active, which stays cached while there are no
+// writers. A writer sets writer_active and then waits for every slot to drain.
+// Readers coming in meanwhile back out and wait for zero_writers. The slots
+// are allocated by the process initializing the lock, so readers of a shared
+// lock all count themselves in shared_readers instead.
+
+static atomic_int num_threads;
+static _Thread_local int reader_slot = -1;
+
+static atomic_int *my_slot(struct read_write_lock *rw) {
+  if (rw->shared) {
+    return &rw->shared_readers;
+  }
+  if (reader_slot == -1) {
+    reader_slot = atomic_fetch_add(&num_threads, 1) % NUM_READER_SLOTS;
+  }
+  return &rw->reader_slots[reader_slot].readers;
+}
+
+static bool readers_present(struct read_write_lock *rw) {
+  if (rw->shared) {
+    return atomic_load(&rw->shared_readers);
+  }
+  for (int i = 0; i < NUM_READER_SLOTS; i++) {
+    if (atomic_load(&rw->reader_slots[i].readers)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void initialize(struct read_write_lock *rw, bool shared) {
+  rw->reader_slots = NULL;
+  if (!shared) {
+    rw->reader_slots =
+        aligned_alloc(64, NUM_READER_SLOTS * sizeof(struct reader_slot));
+    if (rw->reader_slots == NULL) {
+      printf("Couldn't allocate memory for reader slots.\n");
+      exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < NUM_READER_SLOTS; i++) {
+      atomic_init(&rw->reader_slots[i].readers, 0);
+    }
+  }
+  atomic_init(&rw->shared_readers, 0);
+  atomic_init(&rw->writer_active, false);
+  sem_init(&rw->write_lock, shared, 1);
+  init_mutex(&rw->num_writers_lock, shared);
+  init_cond(&rw->zero_writers, shared);
+  init_cond(&rw->zero_readers, shared);
+  init_owner(rw, shared);
+  LOCKSTAT_INIT(rw);
+}
+
+void InitalizeReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, false);
+}
+
+void InitializeSharedReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, true);
+}
+
+void DestroyReadWriteLock(struct read_write_lock *rw) {
+  free(rw->reader_slots);
+  sem_destroy(&rw->write_lock);
+  pthread_mutex_destroy(&rw->num_writers_lock);
+  pthread_cond_destroy(&rw->zero_writers);
+  pthread_cond_destroy(&rw->zero_readers);
+  destroy_owner(rw);
+}
+
+static void leave_readers(struct read_write_lock *rw) {
+  atomic_fetch_sub(my_slot(rw), 1);
+  if (atomic_load(&rw->writer_active)) {
+    lock_mutex(&rw->num_writers_lock);
+    pthread_cond_broadcast(&rw->zero_readers);
+    pthread_mutex_unlock(&rw->num_writers_lock);
+  }
+}
+
+static void join_readers(struct read_write_lock *rw) {
+  atomic_int *slot = my_slot(rw);
+  while (true) {
+    // Both are sequentially consistent, so either the writer sees this reader
+    // or this reader sees the writer
+    atomic_fetch_add(slot, 1);
+    if (!atomic_load(&rw->writer_active)) {
+      return;
+    }
+    leave_readers(rw);
+
+    lock_mutex(&rw->num_writers_lock);
+    while (atomic_load(&rw->writer_active)) {
+      wait_cond(&rw->zero_writers, &rw->num_writers_lock);
+    }
+    pthread_mutex_unlock(&rw->num_writers_lock);
+  }
+}
+
+void ReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void ReaderUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  leave_readers(rw);
+}
+
+static void wait_for_readers(struct read_write_lock *rw) {
+  lock_mutex(&rw->num_writers_lock);
+  while (readers_present(rw)) {
+    wait_cond(&rw->zero_readers, &rw->num_writers_lock);
+  }
+  pthread_mutex_unlock(&rw->num_writers_lock);
+}
+
+void WriterLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  sem_wait(&rw->write_lock);
+  atomic_store(&rw->writer_active, true);
+  wait_for_readers(rw);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+static void release_writer(struct read_write_lock *rw) {
+  lock_mutex(&rw->num_writers_lock);
+  atomic_store(&rw->writer_active, false);
+  pthread_cond_broadcast(&rw->zero_writers);
+  pthread_mutex_unlock(&rw->num_writers_lock);
+  sem_post(&rw->write_lock);
+}
+
+void WriterUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_WRITER);
+  give_up_ownership(rw);
+  release_writer(rw);
+}
+
+// Only writers take write_lock, so it is all the upgradeable reader needs to
+// keep them out
+
+void UpgradeableReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  sem_wait(&rw->write_lock);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void UpgradeableReaderUnlock(struct read_write_lock *rw) {
+  ReaderUnlock(rw);
+  sem_post(&rw->write_lock);
+}
+
+void UpgradeToWriter(struct read_write_lock *rw) {
+  atomic_store(&rw->writer_active, true);
+  ReaderUnlock(rw);
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  wait_for_readers(rw);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+void WriterDowngrade(struct read_write_lock *rw) {
+  LOCKSTAT_DOWNGRADE(rw);
+  give_up_ownership(rw);
+  atomic_fetch_add(my_slot(rw), 1);
+  release_writer(rw);
+}
+
+bool RecoverReadWriteLock(struct read_write_lock *rw) {
+  return owner_died(rw);
+}
@@ -0,0 +1,173 @@
+#include "rwlock.h"
+#include "shared.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+
+// The whole lock is the one word state, so taking and releasing it uncontended
+// is a single atomic instruction. Its low 29 bits count the readers holding
+// it, or are all set while a writer holds it. The upgradeable reader is
+// counted too and sets UPGRADEABLE. Readers don't come in while a writer waits
+// for them to leave (WRITER_WAITING). Threads only sleep in the
+// kernel after setting WAITERS, and whoever clears it wakes them all to try
+// again.
+#define READERS_MASK ((1u << 29) - 1)
+#define WRITER_LOCKED READERS_MASK
+#define UPGRADEABLE (1u << 29)
+#define WRITER_WAITING (1u << 30)
+#define WAITERS (1u << 31)
+
+static void futex_wait(struct read_write_lock *rw, unsigned val) {
+  syscall(SYS_futex, &rw->state, rw->shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE,
+          val, NULL, NULL, 0);
+}
+
+static void futex_wake_all(struct read_write_lock *rw) {
+  syscall(SYS_futex, &rw->state, rw->shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE,
+          INT_MAX, NULL, NULL, 0);
+}
+
+// Sleeps until state is no longer s, after setting WAITERS and bits in it.
+// Returns the new state.
+static unsigned wait_for_change(struct read_write_lock *rw, unsigned s,
+                                unsigned bits) {
+  bits |= WAITERS;
+  if ((s & bits) != bits) {
+    if (!atomic_compare_exchange_weak(&rw->state, &s, s | bits)) {
+      return s;
+    }
+    s |= bits;
+  }
+  futex_wait(rw, s);
+  return atomic_load(&rw->state);
+}
+
+static void wake_waiters(struct read_write_lock *rw) {
+  if (atomic_fetch_and(&rw->state, ~WAITERS) & WAITERS) {
+    futex_wake_all(rw);
+  }
+}
+
+static void initialize(struct read_write_lock *rw, bool shared) {
+  atomic_init(&rw->state, 0);
+  init_owner(rw, shared);
+  LOCKSTAT_INIT(rw);
+}
+
+void InitalizeReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, false);
+}
+
+void InitializeSharedReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, true);
+}
+
+void DestroyReadWriteLock(struct read_write_lock *rw) {
+  destroy_owner(rw);
+}
+
+void ReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  unsigned s = atomic_load_explicit(&rw->state, memory_order_relaxed);
+  while (true) {
+    if (!(s & WRITER_WAITING) && (s & READERS_MASK) < WRITER_LOCKED - 1) {
+      if (atomic_compare_exchange_weak(&rw->state, &s, s + 1)) {
+        LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+        return;
+      }
+    } else {
+      s = wait_for_change(rw, s, 0);
+    }
+  }
+}
+
+void ReaderUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  unsigned s = atomic_fetch_sub(&rw->state, 1) - 1;
+  // The upgradeable reader may be waiting to be the only one left
+  unsigned last = s & UPGRADEABLE ? 1 : 0;
+  if ((s & READERS_MASK) == last && (s & WAITERS)) {
+    wake_waiters(rw);
+  }
+}
+
+void WriterLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  unsigned s = 0;
+  while (true) {
+    if ((s & READERS_MASK) == 0) {
+      // Other writers still waiting set WRITER_WAITING again when woken
+      if (atomic_compare_exchange_weak(&rw->state, &s,
+                                       (s & WAITERS) | WRITER_LOCKED)) {
+        take_ownership(rw);
+        LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+        return;
+      }
+    } else {
+      s = wait_for_change(rw, s, WRITER_WAITING);
+    }
+  }
+}
+
+void WriterUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_WRITER);
+  give_up_ownership(rw);
+  if (atomic_exchange(&rw->state, 0) & WAITERS) {
+    futex_wake_all(rw);
+  }
+}
+
+void UpgradeableReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  unsigned s = atomic_load_explicit(&rw->state, memory_order_relaxed);
+  while (true) {
+    if (!(s & (WRITER_WAITING | UPGRADEABLE)) &&
+        (s & READERS_MASK) < WRITER_LOCKED - 1) {
+      if (atomic_compare_exchange_weak(&rw->state, &s, (s + 1) | UPGRADEABLE)) {
+        LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+        return;
+      }
+    } else {
+      s = wait_for_change(rw, s, 0);
+    }
+  }
+}
+
+void UpgradeableReaderUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  // Other upgradeable readers may be waiting even if readers are left
+  if (atomic_fetch_sub(&rw->state, UPGRADEABLE + 1) & WAITERS) {
+    wake_waiters(rw);
+  }
+}
+
+void UpgradeToWriter(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  unsigned s = atomic_load_explicit(&rw->state, memory_order_relaxed);
+  while (true) {
+    if ((s & READERS_MASK) == 1) {
+      if (atomic_compare_exchange_weak(&rw->state, &s,
+                                       (s & WAITERS) | WRITER_LOCKED)) {
+        take_ownership(rw);
+        LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+        return;
+      }
+    } else {
+      s = wait_for_change(rw, s, WRITER_WAITING);
+    }
+  }
+}
+
+void WriterDowngrade(struct read_write_lock *rw) {
+  LOCKSTAT_DOWNGRADE(rw);
+  give_up_ownership(rw);
+  if (atomic_exchange(&rw->state, 1) & WAITERS) {
+    futex_wake_all(rw);
+  }
+}
+
+bool RecoverReadWriteLock(struct read_write_lock *rw) {
+  return owner_died(rw);
+}
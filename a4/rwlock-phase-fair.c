@@ -0,0 +1,189 @@
+#include "rwlock.h"
+#include "shared.h"
+#include <limits.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <sys/syscall.h>
+
+// Phase-fair ticket lock (Brandenburg and Anderson). Reader and writer phases
+// alternate: a writer waits for at most the readers already inside, and
+// readers arriving after it wait for at most that one writer. Writers are
+// served in ticket order.
+//
+// readers_in and readers_out count readers coming in and going out in steps
+// of READER_INC. The low bits of readers_in are set while a writer is present,
+// along with the parity of writer_phases so that readers can tell one writer
+// phase from the next. That isn't the parity of the ticket since an
+// upgradeable reader takes a ticket without always writing. Waiting threads
+// spin for a while and then sleep until the word they wait on changes.
+#define READER_INC 0x100
+#define WRITER_BITS 0x3
+#define WRITER_PRESENT 0x2
+#define PHASE_ID 0x1
+
+#define SPINS_BEFORE_SLEEP 100
+
+static void futex_wait(struct read_write_lock *rw, atomic_uint *addr,
+                       unsigned val) {
+  syscall(SYS_futex, addr, rw->shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, val,
+          NULL, NULL, 0);
+}
+
+// Wakes the threads sleeping on addr, after it was changed
+static void wake_sleepers(struct read_write_lock *rw, atomic_uint *addr) {
+  if (atomic_load(&rw->sleepers)) {
+    syscall(SYS_futex, addr, rw->shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE,
+            INT_MAX, NULL, NULL, 0);
+  }
+}
+
+// Waits for *addr to be changed from val
+static void wait_for_change(struct read_write_lock *rw, atomic_uint *addr,
+                            unsigned val) {
+  for (int i = 0; i < SPINS_BEFORE_SLEEP; i++) {
+    if (atomic_load(addr) != val) {
+      return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  // Either this thread sleeps before addr changes or whoever changes it sees
+  // the sleeper
+  atomic_fetch_add(&rw->sleepers, 1);
+  futex_wait(rw, addr, val);
+  atomic_fetch_sub(&rw->sleepers, 1);
+}
+
+static void initialize(struct read_write_lock *rw, bool shared) {
+  atomic_init(&rw->readers_in, 0);
+  atomic_init(&rw->readers_out, 0);
+  atomic_init(&rw->writer_ticket, 0);
+  atomic_init(&rw->writer_serving, 0);
+  atomic_init(&rw->writer_phases, 0);
+  atomic_init(&rw->sleepers, 0);
+  init_owner(rw, shared);
+  LOCKSTAT_INIT(rw);
+}
+
+void InitalizeReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, false);
+}
+
+void InitializeSharedReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, true);
+}
+
+void DestroyReadWriteLock(struct read_write_lock *rw) {
+  destroy_owner(rw);
+}
+
+static void join_readers(struct read_write_lock *rw) {
+  unsigned writer = atomic_fetch_add(&rw->readers_in, READER_INC) & WRITER_BITS;
+  while (writer) {
+    unsigned in = atomic_load(&rw->readers_in);
+    if ((in & WRITER_BITS) != writer) {
+      return;
+    }
+    wait_for_change(rw, &rw->readers_in, in);
+  }
+}
+
+static void leave_readers(struct read_write_lock *rw) {
+  atomic_fetch_add(&rw->readers_out, READER_INC);
+  wake_sleepers(rw, &rw->readers_out);
+}
+
+void ReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void ReaderUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  leave_readers(rw);
+}
+
+// Waits for the writers which came before
+static void wait_writer_turn(struct read_write_lock *rw) {
+  unsigned ticket = atomic_fetch_add(&rw->writer_ticket, 1);
+  unsigned serving;
+  while ((serving = atomic_load(&rw->writer_serving)) != ticket) {
+    wait_for_change(rw, &rw->writer_serving, serving);
+  }
+}
+
+// Stops readers coming in and waits for those inside to leave, in the writer
+// turn. The caller itself may be one of them, and leaves after reading
+static void start_writer_phase(struct read_write_lock *rw, bool reading) {
+  unsigned phase = atomic_load(&rw->writer_phases) & PHASE_ID;
+  unsigned readers = atomic_fetch_add(&rw->readers_in, WRITER_PRESENT | phase);
+  if (reading) {
+    leave_readers(rw);
+  }
+  unsigned out;
+  while ((out = atomic_load(&rw->readers_out)) != readers) {
+    wait_for_change(rw, &rw->readers_out, out);
+  }
+}
+
+void WriterLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  wait_writer_turn(rw);
+  start_writer_phase(rw, false);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+static void release_writer(struct read_write_lock *rw) {
+  atomic_fetch_add(&rw->writer_phases, 1);
+  atomic_fetch_and(&rw->readers_in, ~WRITER_BITS);
+  wake_sleepers(rw, &rw->readers_in);
+  atomic_fetch_add(&rw->writer_serving, 1);
+  wake_sleepers(rw, &rw->writer_serving);
+}
+
+void WriterUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_WRITER);
+  give_up_ownership(rw);
+  release_writer(rw);
+}
+
+// The upgradeable reader waits for its turn as a writer, which keeps the
+// writers after it out, and then comes in as a reader. No writer is present
+// during its turn, so that is immediate.
+
+void UpgradeableReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  wait_writer_turn(rw);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void UpgradeableReaderUnlock(struct read_write_lock *rw) {
+  ReaderUnlock(rw);
+  atomic_fetch_add(&rw->writer_serving, 1);
+  wake_sleepers(rw, &rw->writer_serving);
+}
+
+void UpgradeToWriter(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  start_writer_phase(rw, true);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+// Comes in as a reader while the writer is still present, so that the next
+// writer waits for it
+void WriterDowngrade(struct read_write_lock *rw) {
+  LOCKSTAT_DOWNGRADE(rw);
+  give_up_ownership(rw);
+  atomic_fetch_add(&rw->readers_in, READER_INC);
+  release_writer(rw);
+}
+
+bool RecoverReadWriteLock(struct read_write_lock *rw) {
+  return owner_died(rw);
+}
@@ -1,22 +1,51 @@
 #include "rwlock.h"
+#include "shared.h"
+#include "spin.h"
 
-void InitalizeReadWriteLock(struct read_write_lock *rw) {
+static void initialize(struct read_write_lock *rw, bool shared) {
   rw->num_readers = 0;
-  sem_init(&rw->num_readers_lock, 0, 1);
-  sem_init(&rw->write_lock, 0, 1);
+  sem_init(&rw->num_readers_lock, shared, 1);
+  sem_init(&rw->write_lock, shared, 1);
+  sem_init(&rw->upgrade_lock, shared, 1);
+  spin_init(&rw->spin_limit);
+  init_owner(rw, shared);
+  LOCKSTAT_INIT(rw);
 }
 
-void ReaderLock(struct read_write_lock *rw) {
-  sem_wait(&rw->num_readers_lock);
+void InitalizeReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, false);
+}
+
+void InitializeSharedReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, true);
+}
+
+void DestroyReadWriteLock(struct read_write_lock *rw) {
+  sem_destroy(&rw->num_readers_lock);
+  sem_destroy(&rw->write_lock);
+  sem_destroy(&rw->upgrade_lock);
+  destroy_owner(rw);
+}
+
+// Counts one more reader, taking write_lock for the readers if it's the first
+static void join_readers(struct read_write_lock *rw) {
+  adaptive_sem_wait(&rw->spin_limit, &rw->num_readers_lock);
   rw->num_readers++;
   if (rw->num_readers == 1) {
-    sem_wait(&rw->write_lock);
+    adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
   }
   sem_post(&rw->num_readers_lock);
 }
 
+void ReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
 void ReaderUnlock(struct read_write_lock *rw) {
-  sem_wait(&rw->num_readers_lock);
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->num_readers_lock);
   rw->num_readers--;
   if (rw->num_readers == 0) {
     sem_post(&rw->write_lock);
@@ -24,6 +53,53 @@ void ReaderUnlock(struct read_write_lock *rw) {
   sem_post(&rw->num_readers_lock);
 }
 
-void WriterLock(struct read_write_lock *rw) { sem_wait(&rw->write_lock); }
+void WriterLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->upgrade_lock);
+  adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
 
-void WriterUnlock(struct read_write_lock *rw) { sem_post(&rw->write_lock); }
+void WriterUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_WRITER);
+  give_up_ownership(rw);
+  sem_post(&rw->write_lock);
+  sem_post(&rw->upgrade_lock);
+}
+
+// No writer can take write_lock while upgrade_lock is held, so the upgradeable
+// reader only has readers to wait for, and a downgrading writer can let them
+// in before reading itself
+
+void UpgradeableReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->upgrade_lock);
+  join_readers(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void UpgradeableReaderUnlock(struct read_write_lock *rw) {
+  ReaderUnlock(rw);
+  sem_post(&rw->upgrade_lock);
+}
+
+void UpgradeToWriter(struct read_write_lock *rw) {
+  ReaderUnlock(rw);
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+void WriterDowngrade(struct read_write_lock *rw) {
+  LOCKSTAT_DOWNGRADE(rw);
+  give_up_ownership(rw);
+  sem_post(&rw->write_lock);
+  join_readers(rw);
+  sem_post(&rw->upgrade_lock);
+}
+
+bool RecoverReadWriteLock(struct read_write_lock *rw) {
+  return owner_died(rw);
+}
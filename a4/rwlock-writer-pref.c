@@ -1,32 +1,69 @@
 #include "rwlock.h"
+#include "shared.h"
+#include "spin.h"
 
-void InitalizeReadWriteLock(struct read_write_lock *rw) {
+static bool no_writers(void *arg) {
+  struct read_write_lock *rw = arg;
+  return __atomic_load_n(&rw->num_writers, __ATOMIC_RELAXED) == 0;
+}
+
+static void initialize(struct read_write_lock *rw, bool shared) {
   rw->num_writers = 0;
   rw->num_readers = 0;
-  sem_init(&rw->num_readers_lock, 0, 1);
-  sem_init(&rw->write_lock, 0, 1);
-  pthread_mutex_init(&rw->num_writers_lock, NULL);
-  pthread_cond_init(&rw->zero_writers, NULL);
+  sem_init(&rw->num_readers_lock, shared, 1);
+  sem_init(&rw->write_lock, shared, 1);
+  sem_init(&rw->upgrade_lock, shared, 1);
+  init_mutex(&rw->num_writers_lock, shared);
+  init_cond(&rw->zero_writers, shared);
+  spin_init(&rw->spin_limit);
+  init_owner(rw, shared);
+  LOCKSTAT_INIT(rw);
 }
 
-void ReaderLock(struct read_write_lock *rw) {
-  pthread_mutex_lock(&rw->num_writers_lock);
-  while (rw->num_writers > 0) {
-    pthread_cond_wait(&rw->zero_writers, &rw->num_writers_lock);
-  }
+void InitalizeReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, false);
+}
+
+void InitializeSharedReadWriteLock(struct read_write_lock *rw) {
+  initialize(rw, true);
+}
+
+void DestroyReadWriteLock(struct read_write_lock *rw) {
+  sem_destroy(&rw->num_readers_lock);
+  sem_destroy(&rw->write_lock);
+  sem_destroy(&rw->upgrade_lock);
+  pthread_mutex_destroy(&rw->num_writers_lock);
+  pthread_cond_destroy(&rw->zero_writers);
+  destroy_owner(rw);
+}
 
-  sem_wait(&rw->num_readers_lock);
+// Counts one more reader, taking write_lock for the readers if it's the first
+static void join_readers(struct read_write_lock *rw) {
+  adaptive_sem_wait(&rw->spin_limit, &rw->num_readers_lock);
   rw->num_readers++;
   if (rw->num_readers == 1) {
-    sem_wait(&rw->write_lock);
+    adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
   }
   sem_post(&rw->num_readers_lock);
+}
+
+void ReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  // Rechecked under num_writers_lock, this only saves sleeping on zero_writers
+  spin_until(&rw->spin_limit, no_writers, rw);
+  lock_mutex(&rw->num_writers_lock);
+  while (rw->num_writers > 0) {
+    wait_cond(&rw->zero_writers, &rw->num_writers_lock);
+  }
+  join_readers(rw);
   pthread_mutex_unlock(&rw->num_writers_lock);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
 }
 
 void ReaderUnlock(struct read_write_lock *rw) {
-  pthread_mutex_lock(&rw->num_writers_lock);
-  sem_wait(&rw->num_readers_lock);
+  LOCKSTAT_RELEASE(rw, LOCK_READER);
+  lock_mutex(&rw->num_writers_lock);
+  adaptive_sem_wait(&rw->spin_limit, &rw->num_readers_lock);
   rw->num_readers--;
   if (rw->num_readers == 0) {
     sem_post(&rw->write_lock);
@@ -36,18 +73,73 @@ void ReaderUnlock(struct read_write_lock *rw) {
 }
 
 void WriterLock(struct read_write_lock *rw) {
-  pthread_mutex_lock(&rw->num_writers_lock);
-  rw->num_writers++;
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  lock_mutex(&rw->num_writers_lock);
+  // Atomic since spinning readers read it without num_writers_lock
+  __atomic_add_fetch(&rw->num_writers, 1, __ATOMIC_RELAXED);
   pthread_mutex_unlock(&rw->num_writers_lock);
-  sem_wait(&rw->write_lock);
+  adaptive_sem_wait(&rw->spin_limit, &rw->upgrade_lock);
+  adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
 }
 
 void WriterUnlock(struct read_write_lock *rw) {
+  LOCKSTAT_RELEASE(rw, LOCK_WRITER);
+  give_up_ownership(rw);
   sem_post(&rw->write_lock);
-  pthread_mutex_lock(&rw->num_writers_lock);
-  rw->num_writers--;
-  if (rw->num_writers == 0) {
+  sem_post(&rw->upgrade_lock);
+  lock_mutex(&rw->num_writers_lock);
+  if (__atomic_sub_fetch(&rw->num_writers, 1, __ATOMIC_RELAXED) == 0) {
     pthread_cond_broadcast(&rw->zero_writers);
   }
   pthread_mutex_unlock(&rw->num_writers_lock);
 }
+
+// Writers count themselves in num_writers before waiting for upgrade_lock, so
+// the upgradeable reader comes in without waiting for them to be gone, and
+// write_lock is free or held by the readers once it has upgrade_lock
+
+void UpgradeableReaderLock(struct read_write_lock *rw) {
+  LOCKSTAT_BEGIN(rw, LOCK_READER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->upgrade_lock);
+  lock_mutex(&rw->num_writers_lock);
+  join_readers(rw);
+  pthread_mutex_unlock(&rw->num_writers_lock);
+  LOCKSTAT_ACQUIRED(rw, LOCK_READER);
+}
+
+void UpgradeableReaderUnlock(struct read_write_lock *rw) {
+  ReaderUnlock(rw);
+  sem_post(&rw->upgrade_lock);
+}
+
+void UpgradeToWriter(struct read_write_lock *rw) {
+  lock_mutex(&rw->num_writers_lock);
+  __atomic_add_fetch(&rw->num_writers, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&rw->num_writers_lock);
+  ReaderUnlock(rw);
+  LOCKSTAT_BEGIN(rw, LOCK_WRITER);
+  adaptive_sem_wait(&rw->spin_limit, &rw->write_lock);
+  take_ownership(rw);
+  LOCKSTAT_ACQUIRED(rw, LOCK_WRITER);
+}
+
+void WriterDowngrade(struct read_write_lock *rw) {
+  LOCKSTAT_DOWNGRADE(rw);
+  give_up_ownership(rw);
+  lock_mutex(&rw->num_writers_lock);
+  // Its write_lock becomes the readers'
+  adaptive_sem_wait(&rw->spin_limit, &rw->num_readers_lock);
+  rw->num_readers++;
+  sem_post(&rw->num_readers_lock);
+  if (__atomic_sub_fetch(&rw->num_writers, 1, __ATOMIC_RELAXED) == 0) {
+    pthread_cond_broadcast(&rw->zero_writers);
+  }
+  pthread_mutex_unlock(&rw->num_writers_lock);
+  sem_post(&rw->upgrade_lock);
+}
+
+bool RecoverReadWriteLock(struct read_write_lock *rw) {
+  return owner_died(rw);
+}
@@ -1,9 +1,20 @@
 #include <pthread.h>
 #include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 
+#include "lockstat.h"
+
+#define NUM_READER_SLOTS 64
+
+// A count of readers on a cache line of its own
+struct reader_slot {
+  _Alignas(64) atomic_int readers;
+};
+
 struct read_write_lock {
   sem_t num_readers_lock; // lock for num_readers
   pthread_mutex_t num_writers_lock;
@@ -11,10 +22,59 @@ struct read_write_lock {
   sem_t write_lock; // lock which writers must have to write
   int num_readers;  // Number of readers currently reading the resource
   int num_writers;  // Number of writers waiting or currently writing
+  sem_t upgrade_lock; // Held by the writer or the upgradeable reader
+  atomic_uint state; // Whole state of the futex lock, see rwlock-futex.c
+  // Readers of the distributed lock, each thread counted in one of
+  // NUM_READER_SLOTS slots allocated by its initializer, or all in
+  // shared_readers if the lock is shared
+  struct reader_slot *reader_slots;
+  atomic_int shared_readers;
+  atomic_bool writer_active; // Set while a writer waits or writes
+  pthread_cond_t zero_readers;
+  // Tickets of the phase-fair lock, see rwlock-phase-fair.c
+  atomic_uint readers_in;
+  atomic_uint readers_out;
+  atomic_uint writer_ticket;
+  atomic_uint writer_serving;
+  atomic_uint writer_phases; // Writer phases so far
+  atomic_int sleepers; // Threads waiting on one of them in the kernel
+  atomic_int spin_limit; // Spins before sleeping, see spin.h
+  bool shared; // Used by several processes, see shared.h
+  pthread_mutex_t owner_lock; // Held by the writer of a shared lock
+#ifdef RWLOCK_STATS
+  struct lock_stats stats; // See lockstat.h
+#endif
 };
 
 void InitalizeReadWriteLock(struct read_write_lock *rw);
+// Initializes a lock in memory shared by several processes
+void InitializeSharedReadWriteLock(struct read_write_lock *rw);
+// Frees what the lock uses, once no thread uses it anymore
+void DestroyReadWriteLock(struct read_write_lock *rw);
+// If the process holding the write lock of a shared lock died, makes the
+// caller the writer in its place and returns true. The caller then repairs
+// what the dead one was writing and calls WriterUnlock. A process that finds
+// out another died, from waitpid say, calls it to let in the threads waiting
+// for the dead one.
+bool RecoverReadWriteLock(struct read_write_lock *rw);
 void ReaderLock(struct read_write_lock *rw);
 void ReaderUnlock(struct read_write_lock *rw);
 void WriterLock(struct read_write_lock *rw);
 void WriterUnlock(struct read_write_lock *rw);
+
+// The upgradeable reader reads along with other readers, but there's only one
+// at a time and writers wait for it to be done, so that it can become the
+// writer without another one slipping in first
+void UpgradeableReaderLock(struct read_write_lock *rw);
+void UpgradeableReaderUnlock(struct read_write_lock *rw);
+// Turns the upgradeable read lock into the write lock, released by
+// WriterUnlock
+void UpgradeToWriter(struct read_write_lock *rw);
+// Turns the write lock into a read lock, released by ReaderUnlock, with no
+// other writer in between
+void WriterDowngrade(struct read_write_lock *rw);
+
+// Starts keeping contention statistics for a lock built with -DRWLOCK_STATS,
+// before any thread uses it, and writes them to file. Both are in lockstat.c.
+void EnableLockStats(struct read_write_lock *rw);
+void DumpLockStats(struct read_write_lock *rw, FILE *file);
@@ -0,0 +1,80 @@
+#include "seqlock.h"
+#include "spin.h"
+#include <sched.h>
+
+#define SPINS_BEFORE_YIELD 100
+
+void InitializeSeqLock(struct seqlock *sl) {
+  atomic_init(&sl->sequence, 0);
+  pthread_mutex_init(&sl->write_lock, NULL);
+}
+
+unsigned ReadSeqBegin(struct seqlock *sl) {
+  unsigned sequence;
+  int spins = 0;
+  while ((sequence = atomic_load_explicit(&sl->sequence,
+                                          memory_order_acquire)) & 1) {
+    // The writer may need this CPU to finish
+    if (++spins < SPINS_BEFORE_YIELD) {
+      cpu_relax();
+    } else {
+      sched_yield();
+    }
+  }
+  return sequence;
+}
+
+bool ReadSeqRetry(struct seqlock *sl, unsigned sequence) {
+  // Orders the reads of the data before that of the sequence
+  atomic_thread_fence(memory_order_acquire);
+  return atomic_load_explicit(&sl->sequence, memory_order_relaxed) != sequence;
+}
+
+void WriteSeqLock(struct seqlock *sl) {
+  pthread_mutex_lock(&sl->write_lock);
+  unsigned sequence = atomic_load_explicit(&sl->sequence, memory_order_relaxed);
+  atomic_store_explicit(&sl->sequence, sequence + 1, memory_order_relaxed);
+  // Orders the odd sequence before the writes of the data
+  atomic_thread_fence(memory_order_release);
+}
+
+void WriteSeqUnlock(struct seqlock *sl) {
+  unsigned sequence = atomic_load_explicit(&sl->sequence, memory_order_relaxed);
+  atomic_store_explicit(&sl->sequence, sequence + 1, memory_order_release);
+  pthread_mutex_unlock(&sl->write_lock);
+}
+
+// The data is copied a word at a time where it's aligned, with relaxed atomic
+// loads and stores, since readers race with the writer by design
+
+void SeqLockRead(struct seqlock *sl, void *dst, const void *src, size_t size) {
+  unsigned sequence;
+  do {
+    sequence = ReadSeqBegin(sl);
+    size_t i = 0;
+    if ((size_t)dst % sizeof(long) == 0 && (size_t)src % sizeof(long) == 0) {
+      for (; i + sizeof(long) <= size; i += sizeof(long)) {
+        *(long *)((char *)dst + i) =
+            __atomic_load_n((long *)((char *)src + i), __ATOMIC_RELAXED);
+      }
+    }
+    for (; i < size; i++) {
+      ((char *)dst)[i] = __atomic_load_n((char *)src + i, __ATOMIC_RELAXED);
+    }
+  } while (ReadSeqRetry(sl, sequence));
+}
+
+void SeqLockWrite(struct seqlock *sl, void *dst, const void *src, size_t size) {
+  WriteSeqLock(sl);
+  size_t i = 0;
+  if ((size_t)dst % sizeof(long) == 0 && (size_t)src % sizeof(long) == 0) {
+    for (; i + sizeof(long) <= size; i += sizeof(long)) {
+      __atomic_store_n((long *)((char *)dst + i),
+                       *(long *)((char *)src + i), __ATOMIC_RELAXED);
+    }
+  }
+  for (; i < size; i++) {
+    __atomic_store_n((char *)dst + i, ((char *)src)[i], __ATOMIC_RELAXED);
+  }
+  WriteSeqUnlock(sl);
+}
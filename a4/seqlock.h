@@ -0,0 +1,26 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// A sequence lock for small data which is read far more often than written.
+// Readers never write to shared memory: they read the data and check that no
+// writer started or finished meanwhile, trying again if one did.
+struct seqlock {
+  atomic_uint sequence; // Odd while a writer is writing
+  pthread_mutex_t write_lock; // Lock which writers must have to write
+};
+
+void InitializeSeqLock(struct seqlock *sl);
+// A read between ReadSeqBegin and ReadSeqRetry must be tried again if
+// ReadSeqRetry returns true. The data may change while it's read, so it must
+// be read with atomic loads, as SeqLockRead does.
+unsigned ReadSeqBegin(struct seqlock *sl);
+bool ReadSeqRetry(struct seqlock *sl, unsigned sequence);
+void WriteSeqLock(struct seqlock *sl);
+void WriteSeqUnlock(struct seqlock *sl);
+
+// Copies size bytes of the data at src, protected by sl, to dst
+void SeqLockRead(struct seqlock *sl, void *dst, const void *src, size_t size);
+// Copies size bytes from src to the data at dst, protected by sl
+void SeqLockWrite(struct seqlock *sl, void *dst, const void *src, size_t size);
@@ -0,0 +1,93 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+// A shared lock lives in memory mapped by several processes (mmap with
+// MAP_SHARED, or shm_open), so its semaphores, mutexes, condition variables
+// and futexes are all set up to be used across processes. Its mutexes are
+// robust: when a process dies holding one, the next thread to lock it takes
+// it over.
+//
+// The writer of a shared lock also holds owner_lock while it writes, so that
+// if its process dies, RecoverReadWriteLock can tell and hand the lock over.
+// A process dying while it waits for the lock, or while it reads, can't be
+// recovered from.
+
+static inline void init_mutex(pthread_mutex_t *m, bool shared) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  if (shared) {
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  }
+  pthread_mutex_init(m, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+static inline void init_cond(pthread_cond_t *c, bool shared) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  if (shared) {
+    pthread_condattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  }
+  pthread_cond_init(c, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+// The state a mutex guards is only ever counts updated in one step, so it's
+// still consistent when the owner died
+static inline void lock_mutex(pthread_mutex_t *m) {
+  if (pthread_mutex_lock(m) == EOWNERDEAD) {
+    pthread_mutex_consistent(m);
+  }
+}
+
+static inline void wait_cond(pthread_cond_t *c, pthread_mutex_t *m) {
+  if (pthread_cond_wait(c, m) == EOWNERDEAD) {
+    pthread_mutex_consistent(m);
+  }
+}
+
+static inline void init_owner(struct read_write_lock *rw, bool shared) {
+  rw->shared = shared;
+  if (shared) {
+    init_mutex(&rw->owner_lock, true);
+  }
+}
+
+static inline void destroy_owner(struct read_write_lock *rw) {
+  if (rw->shared) {
+    pthread_mutex_destroy(&rw->owner_lock);
+  }
+}
+
+// Called by the writer once it has the lock
+static inline void take_ownership(struct read_write_lock *rw) {
+  if (rw->shared) {
+    lock_mutex(&rw->owner_lock);
+  }
+}
+
+// Called by the writer before releasing the lock
+static inline void give_up_ownership(struct read_write_lock *rw) {
+  if (rw->shared) {
+    pthread_mutex_unlock(&rw->owner_lock);
+  }
+}
+
+// Returns whether the writer holding the lock died, in which case the caller
+// holds the lock and owner_lock in its place
+static inline bool owner_died(struct read_write_lock *rw) {
+  if (!rw->shared) {
+    return false;
+  }
+  int ret = pthread_mutex_trylock(&rw->owner_lock);
+  if (ret == EOWNERDEAD) {
+    pthread_mutex_consistent(&rw->owner_lock);
+    return true;
+  }
+  if (ret == 0) {
+    pthread_mutex_unlock(&rw->owner_lock);
+  }
+  return false;
+}
@@ -0,0 +1,67 @@
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+// Waiting for a lock spins for a while before sleeping, as putting a thread to
+// sleep and waking it costs far more than a short critical section. How long
+// to spin follows how long recent waits took: a wait which ends while
+// spinning moves the limit towards twice its length, and one which has to
+// sleep moves it down, so spinning stops paying off when the lock is held for
+// long. Spins are counted in pauses, with exponential backoff between checks.
+// There's no spinning at all on a single CPU since the holder can't run.
+#define MIN_SPINS 16
+#define MAX_SPINS 4096
+#define MAX_PAUSES 64
+
+static inline void spin_init(atomic_int *spin_limit) {
+  atomic_init(spin_limit, sysconf(_SC_NPROCESSORS_ONLN) > 1 ? MIN_SPINS : 0);
+}
+
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+
+static inline int clamp_spins(int spins) {
+  return spins < MIN_SPINS ? MIN_SPINS : spins > MAX_SPINS ? MAX_SPINS : spins;
+}
+
+// Spins until done(arg) returns true, or returns false if it took too long
+static inline bool spin_until(atomic_int *spin_limit, bool (*done)(void *),
+                              void *arg) {
+  if (done(arg)) {
+    return true;
+  }
+  int limit = atomic_load_explicit(spin_limit, memory_order_relaxed);
+  if (limit == 0) {
+    return false;
+  }
+  int pauses = 1;
+  for (int spins = 0; spins < limit; spins += pauses) {
+    for (int i = 0; i < pauses; i++) {
+      cpu_relax();
+    }
+    if (pauses < MAX_PAUSES) {
+      pauses *= 2;
+    }
+    if (done(arg)) {
+      atomic_store_explicit(spin_limit,
+                            clamp_spins(limit + (2 * spins - limit) / 8),
+                            memory_order_relaxed);
+      return true;
+    }
+  }
+  atomic_store_explicit(spin_limit, clamp_spins(limit - limit / 8),
+                        memory_order_relaxed);
+  return false;
+}
+
+static inline bool sem_taken(void *sem) { return sem_trywait(sem) == 0; }
+
+static inline void adaptive_sem_wait(atomic_int *spin_limit, sem_t *sem) {
+  if (!spin_until(spin_limit, sem_taken, sem)) {
+    sem_wait(sem);
+  }
+}
@@ -0,0 +1,105 @@
+#include "rwlock.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+// Reader and writer processes share a lock and a table of values in a
+// MAP_SHARED mapping. Writers add one to every value, so readers should always
+// find them all equal. One more process dies halfway through a write, and
+// the parent recovers the lock from it and undoes the partial write.
+
+#define NUM_VALUES 8
+#define ITERATIONS 20000
+
+struct shared {
+  struct read_write_lock rwlock;
+  long values[NUM_VALUES];
+  long num_errors;
+};
+
+struct shared *shared;
+
+void Reader() {
+  for (int i = 0; i < ITERATIONS; i++) {
+    ReaderLock(&shared->rwlock);
+    for (int j = 1; j < NUM_VALUES; j++) {
+      if (shared->values[j] != shared->values[0]) {
+        __atomic_add_fetch(&shared->num_errors, 1, __ATOMIC_RELAXED);
+        break;
+      }
+    }
+    ReaderUnlock(&shared->rwlock);
+  }
+}
+
+void Writer() {
+  for (int i = 0; i < ITERATIONS; i++) {
+    WriterLock(&shared->rwlock);
+    for (int j = 0; j < NUM_VALUES; j++) {
+      shared->values[j]++;
+    }
+    WriterUnlock(&shared->rwlock);
+  }
+}
+
+void Crasher() {
+  WriterLock(&shared->rwlock);
+  for (int j = 0; j < NUM_VALUES / 2; j++) {
+    shared->values[j] = -1;
+  }
+  _exit(EXIT_SUCCESS);
+}
+
+pid_t spawn(void (*start)()) {
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    start();
+    exit(EXIT_SUCCESS);
+  }
+  return pid;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    printf("Usage: %s <readers> <writers>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  int num_readers = atoi(argv[1]);
+  int num_writers = atoi(argv[2]);
+
+  shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  InitializeSharedReadWriteLock(&shared->rwlock);
+
+  for (int i = 0; i < num_readers; i++) {
+    spawn(Reader);
+  }
+  for (int i = 0; i < num_writers; i++) {
+    spawn(Writer);
+  }
+  waitpid(spawn(Crasher), NULL, 0);
+  bool recovered = RecoverReadWriteLock(&shared->rwlock);
+  if (recovered) {
+    for (int j = 0; j < NUM_VALUES / 2; j++) {
+      shared->values[j] = shared->values[NUM_VALUES - 1];
+    }
+    WriterUnlock(&shared->rwlock);
+  }
+  while (wait(NULL) > 0) {
+  }
+
+  long expected = (long)num_writers * ITERATIONS;
+  if (shared->values[0] != expected) {
+    shared->num_errors++;
+  }
+  printf("Recovered: %s Writes: %ld Errors: %ld\n", recovered ? "yes" : "no",
+         shared->values[0], shared->num_errors);
+  return recovered && !shared->num_errors ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+#include "rwlock.h"
+
+// Upgraders look keys up in a table and insert the missing ones, upgrading
+// their read lock to do so, while writers remove keys and downgrade to check
+// that the key stays removed. Neither should ever find that another writer
+// got in between.
+
+#define NUM_KEYS 64
+#define ITERATIONS 20000
+
+struct read_write_lock rwlock;
+int table[NUM_KEYS];
+long num_upgrades;
+long num_downgrades;
+long num_errors;
+
+void *Reader(void *arg) {
+  int threadNumber = *((int *)arg);
+  unsigned seed = threadNumber;
+  for (int i = 0; i < ITERATIONS; i++) {
+    ReaderLock(&rwlock);
+    int key = rand_r(&seed) % NUM_KEYS;
+    if (table[key] != 0 && table[key] != 1) {
+      __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+    }
+    ReaderUnlock(&rwlock);
+  }
+  return NULL;
+}
+
+void *Upgrader(void *arg) {
+  int threadNumber = *((int *)arg);
+  unsigned seed = threadNumber;
+  for (int i = 0; i < ITERATIONS; i++) {
+    int key = rand_r(&seed) % NUM_KEYS;
+    UpgradeableReaderLock(&rwlock);
+    if (table[key]) {
+      UpgradeableReaderUnlock(&rwlock);
+      continue;
+    }
+
+    UpgradeToWriter(&rwlock);
+    if (table[key]) { // Someone inserted it since the lookup
+      __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+    }
+    table[key] = 1;
+    num_upgrades++;
+    WriterUnlock(&rwlock);
+  }
+  return NULL;
+}
+
+void *Writer(void *arg) {
+  int threadNumber = *((int *)arg);
+  unsigned seed = threadNumber;
+  for (int i = 0; i < ITERATIONS; i++) {
+    int key = rand_r(&seed) % NUM_KEYS;
+    WriterLock(&rwlock);
+    table[key] = 0;
+    WriterDowngrade(&rwlock);
+    if (table[key]) { // Someone inserted it since the removal
+      __atomic_add_fetch(&num_errors, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&num_downgrades, 1, __ATOMIC_RELAXED);
+    ReaderUnlock(&rwlock);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 4) {
+    printf("Usage: %s <readers> <upgraders> <writers>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  int num_readers = atoi(argv[1]);
+  int num_upgraders = atoi(argv[2]);
+  int num_writers = atoi(argv[3]);
+  int num_threads = num_readers + num_upgraders + num_writers;
+
+  InitalizeReadWriteLock(&rwlock);
+  pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+  int *threadNumbers = malloc(num_threads * sizeof(int));
+  if (threads == NULL || threadNumbers == NULL) {
+    printf("Couldn't allocate memory for threads.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (int i = 0; i < num_threads; i++) {
+    threadNumbers[i] = i;
+    void *(*start)(void *) = i < num_readers ? Reader
+                             : i < num_readers + num_upgraders ? Upgrader
+                                                               : Writer;
+    int ret = pthread_create(&threads[i], NULL, start, &threadNumbers[i]);
+    if (ret) {
+      printf("Error - pthread_create() return code: %d\n", ret);
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  printf("Upgrades: %ld Downgrades: %ld Errors: %ld\n", num_upgrades,
+         num_downgrades, num_errors);
+  return num_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}